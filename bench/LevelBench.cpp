@@ -0,0 +1,638 @@
+// Standalone benchmark for chunk assembly, allocators and level I/O.
+// Generates synthetic chunk files, runs each benchmark a number of times and reports
+// latency percentiles, throughput and peak RSS. See README.md for how to build it.
+
+#include "Asset.h"
+#include "Level.h"
+#include "StackAllocator.h"
+#include "TlsfAllocator.h"
+#include "ObjectPool.h"
+#include "Logger.h"
+#include "ChunkCatalog.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#include <direct.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+    struct BenchOptions
+    {
+        size_t chunkCount = 64;
+        size_t minChunkSize = 64 * 1024;
+        size_t maxChunkSize = 1024 * 1024;
+        size_t totalSize = 0;                 // Scales the chunk sizes to this total when set
+        std::string distribution = "uniform"; // uniform, lognormal or fixed
+        double duplicateRatio = 0.0;          // Share of chunks that repeat an earlier chunk's bytes
+        double randomFraction = 0.5;          // Share of 4KB blocks filled with noise, the rest compresses well
+        int iterations = 5;
+        unsigned int seed = 1;
+        std::string workDir = "bench_data";
+        std::string filter;                   // Only runs benchmarks whose name contains this
+    };
+
+    // Latency samples of one benchmark, in seconds
+    class Samples
+    {
+    public:
+        void Add(double seconds)
+        {
+            values.push_back(seconds);
+        }
+
+        double Percentile(double percentile) const
+        {
+            if (values.empty())
+            {
+                return 0.0;
+            }
+            std::vector<double> sorted = values;
+            std::sort(sorted.begin(), sorted.end());
+            size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0 * sorted.size()));
+            return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+        }
+
+        double Total() const
+        {
+            double total = 0.0;
+            for (double value : values)
+            {
+                total += value;
+            }
+            return total;
+        }
+
+        size_t Count() const
+        {
+            return values.size();
+        }
+
+    private:
+        std::vector<double> values;
+    };
+
+    class Stopwatch
+    {
+    public:
+        Stopwatch() : start(std::chrono::steady_clock::now()) {}
+
+        double Elapsed() const
+        {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+    private:
+        std::chrono::steady_clock::time_point start;
+    };
+
+    size_t GetPeakRss()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        return static_cast<size_t>(usage.ru_maxrss);
+#else
+        return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+    }
+
+    void MakeDirectory(const std::string& path)
+    {
+#ifdef _WIN32
+        _mkdir(path.c_str());
+#else
+        mkdir(path.c_str(), 0755);
+#endif
+    }
+
+    // Prints one result line, bytes is the data moved by each sample (0 for counted operations)
+    void Report(const std::string& name, const Samples& samples, double bytesPerSample, double opsPerSample = 1.0)
+    {
+        const double toMicroseconds = 1e6;
+        std::ostream& out = std::cout;
+        out << std::left << std::setw(40) << name << std::right
+            << std::setw(6) << samples.Count()
+            << std::fixed << std::setprecision(1)
+            << std::setw(12) << samples.Percentile(50) * toMicroseconds
+            << std::setw(12) << samples.Percentile(90) * toMicroseconds
+            << std::setw(12) << samples.Percentile(99) * toMicroseconds
+            << std::setw(12) << samples.Percentile(100) * toMicroseconds;
+
+        double seconds = samples.Total();
+        if (bytesPerSample > 0 && seconds > 0)
+        {
+            out << std::setw(12) << (bytesPerSample * samples.Count() / seconds) / (1024.0 * 1024.0) << " MB/s";
+        }
+        else if (seconds > 0)
+        {
+            out << std::setw(12) << (opsPerSample * samples.Count() / seconds) / 1e6 << " Mop/s";
+        }
+        out << std::setw(10) << GetPeakRss() / (1024 * 1024) << " MB" << std::endl;
+    }
+
+    std::vector<size_t> GenerateChunkSizes(const BenchOptions& options, std::mt19937& rng)
+    {
+        std::vector<size_t> sizes(options.chunkCount);
+        std::uniform_int_distribution<size_t> uniform(options.minChunkSize, std::max(options.minChunkSize, options.maxChunkSize));
+        double median = std::sqrt(static_cast<double>(options.minChunkSize) * static_cast<double>(options.maxChunkSize));
+        std::lognormal_distribution<double> lognormal(std::log(std::max(median, 1.0)), 0.75);
+
+        for (auto& size : sizes)
+        {
+            if (options.distribution == "fixed")
+            {
+                size = options.maxChunkSize;
+            }
+            else if (options.distribution == "lognormal")
+            {
+                double sample = lognormal(rng);
+                size = static_cast<size_t>(std::min(std::max(sample, static_cast<double>(options.minChunkSize)), static_cast<double>(options.maxChunkSize)));
+            }
+            else
+            {
+                size = uniform(rng);
+            }
+        }
+
+        if (options.totalSize > 0)
+        {
+            double sum = 0.0;
+            for (size_t size : sizes)
+            {
+                sum += static_cast<double>(size);
+            }
+            for (auto& size : sizes)
+            {
+                size = std::max<size_t>(1, static_cast<size_t>(static_cast<double>(size) * options.totalSize / sum));
+            }
+        }
+        return sizes;
+    }
+
+    // Writes the synthetic chunk files and returns their paths
+    std::vector<std::string> GenerateChunks(const BenchOptions& options)
+    {
+        std::mt19937 rng(options.seed);
+        std::vector<size_t> sizes = GenerateChunkSizes(options, rng);
+        std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+        MakeDirectory(options.workDir);
+        std::vector<std::string> chunkFiles;
+        for (size_t i = 0; i < options.chunkCount; ++i)
+        {
+            // Duplicates are read back from disk, so only one chunk is in memory at a time
+            std::vector<char> bytes;
+            if (i > 0 && chance(rng) < options.duplicateRatio)
+            {
+                std::ifstream original(chunkFiles[std::uniform_int_distribution<size_t>(0, i - 1)(rng)], std::ios::binary);
+                bytes.assign(std::istreambuf_iterator<char>(original), std::istreambuf_iterator<char>());
+            }
+            else
+            {
+                bytes.resize(sizes[i]);
+                for (size_t block = 0; block < bytes.size(); block += 4096)
+                {
+                    size_t blockEnd = std::min(bytes.size(), block + 4096);
+                    bool noise = chance(rng) < options.randomFraction;
+                    for (size_t b = block; b < blockEnd; ++b)
+                    {
+                        bytes[b] = noise ? static_cast<char>(rng()) : static_cast<char>((b / 64) % 16);
+                    }
+                }
+            }
+
+            std::string path = options.workDir + "/chunk" + std::to_string(i) + ".bin";
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write(bytes.data(), bytes.size());
+            chunkFiles.push_back(path);
+        }
+        return chunkFiles;
+    }
+
+    bool Selected(const BenchOptions& options, const std::string& name)
+    {
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    }
+
+    void BenchAddChunk(const BenchOptions& options, const std::vector<std::string>& chunkFiles, size_t totalSize, Level::ChunkIngestMode mode, const std::string& name, size_t prefetchWindow = 0)
+    {
+        if (!Selected(options, name))
+        {
+            return;
+        }
+
+        Samples samples;
+        for (int iteration = 0; iteration < options.iterations; ++iteration)
+        {
+            StackAllocator allocator(totalSize, true);
+            ObjectPool<FileChunk> fileChunkPool(chunkFiles.size());
+            ObjectPool<Asset> assetPool(chunkFiles.size());
+            Level level(totalSize);
+            level.SetChunkManifest(chunkFiles, fileChunkPool);
+            level.SetIngestMode(mode);
+            level.SetPrefetchWindow(prefetchWindow);
+            level.CreateImageBuffer(totalSize);
+
+            for (size_t i = 0; i < chunkFiles.size(); ++i)
+            {
+                Stopwatch timer;
+                level.AddChunk(static_cast<int>(i), chunkFiles[i], allocator, fileChunkPool, assetPool);
+                samples.Add(timer.Elapsed());
+            }
+        }
+        Report(name, samples, static_cast<double>(totalSize) / chunkFiles.size());
+    }
+
+    void BenchAssembly(const BenchOptions& options, const std::vector<std::string>& chunkFiles, size_t totalSize)
+    {
+        const std::string imagePath = options.workDir + "/image.tga";
+        const char* names[] = { "AssembleChunks", "AssembleChunksParallel", "AssembleChunksStreaming" };
+        for (int variant = 0; variant < 3; ++variant)
+        {
+            if (!Selected(options, names[variant]))
+            {
+                continue;
+            }
+
+            Samples samples;
+            for (int iteration = 0; iteration < options.iterations; ++iteration)
+            {
+                    StackAllocator allocator(totalSize, true);
+                ObjectPool<FileChunk> fileChunkPool(chunkFiles.size());
+                ObjectPool<Asset> assetPool(chunkFiles.size());
+                Level level(totalSize);
+                if (variant < 2)
+                {
+                    level.CreateImageBuffer(totalSize);
+                }
+
+                Stopwatch timer;
+                if (variant == 0)
+                {
+                    level.AssembleChunks(chunkFiles, allocator, fileChunkPool, imagePath, assetPool);
+                }
+                else if (variant == 1)
+                {
+                    level.AssembleChunksParallel(chunkFiles, fileChunkPool, imagePath);
+                }
+                else
+                {
+                    level.AssembleChunksStreaming(chunkFiles, fileChunkPool, imagePath);
+                }
+                samples.Add(timer.Elapsed());
+            }
+            Report(names[variant], samples, static_cast<double>(totalSize));
+        }
+    }
+
+    void BenchLevelIO(const BenchOptions& options, const std::vector<std::string>& chunkFiles, size_t totalSize)
+    {
+        ObjectPool<FileChunk> fileChunkPool(chunkFiles.size());
+        Level level(totalSize);
+        level.CreateImageBuffer(totalSize);
+        if (!level.AssembleChunksParallel(chunkFiles, fileChunkPool, options.workDir + "/image.tga"))
+        {
+            std::cerr << "Benchmark setup failed, chunks could not be assembled." << std::endl;
+            return;
+        }
+
+        for (int compress = 0; compress < 2; ++compress)
+        {
+            const std::string levelPath = options.workDir + (compress ? "/level_compressed.bin" : "/level.bin");
+            const std::string suffix = compress ? " (compressed)" : "";
+
+            Samples saves;
+            for (int iteration = 0; iteration < options.iterations; ++iteration)
+            {
+                // A level that has not saved yet, so every chunk is written from memory
+                Level saveLevel(totalSize);
+                saveLevel.CreateImageBuffer(totalSize);
+                ObjectPool<FileChunk> savePool(chunkFiles.size());
+                saveLevel.AssembleChunksParallel(chunkFiles, savePool, options.workDir + "/image.tga");
+
+                Stopwatch timer;
+                saveLevel.SaveLevel(levelPath, compress != 0);
+                saves.Add(timer.Elapsed());
+            }
+
+            Samples loads;
+            Samples verifies;
+            for (int iteration = 0; iteration < options.iterations; ++iteration)
+            {
+                StackAllocator allocator(totalSize, true);
+                ObjectPool<FileChunk> loadPool(chunkFiles.size());
+                ObjectPool<Asset> assetPool(chunkFiles.size());
+                Level loadLevel;
+
+                Stopwatch timer;
+                loadLevel.LoadLevel(levelPath, allocator, loadPool, assetPool);
+                loadLevel.LoadAllChunks(allocator, loadPool);
+                loads.Add(timer.Elapsed());
+
+                Stopwatch verifyTimer;
+                Level::VerifyLevel(levelPath);
+                verifies.Add(verifyTimer.Elapsed());
+            }
+
+            if (Selected(options, "SaveLevel"))
+            {
+                Report("SaveLevel" + suffix, saves, static_cast<double>(totalSize));
+            }
+            if (Selected(options, "LoadLevel"))
+            {
+                Report("LoadLevel+LoadAllChunks" + suffix, loads, static_cast<double>(totalSize));
+            }
+            if (Selected(options, "VerifyLevel"))
+            {
+                Report("VerifyLevel" + suffix, verifies, static_cast<double>(totalSize));
+            }
+        }
+
+        if (Selected(options, "SaveImage"))
+        {
+            Samples samples;
+            for (int iteration = 0; iteration < options.iterations; ++iteration)
+            {
+                Stopwatch timer;
+                level.SaveImage(options.workDir + "/image.tga");
+                samples.Add(timer.Elapsed());
+            }
+            Report("SaveImage", samples, static_cast<double>(totalSize));
+        }
+    }
+
+    // Chunk sizing with an empty catalog stats every file, a warm one answers from memory. Refresh re-stats every entry.
+    void BenchChunkCatalog(const BenchOptions& options, const std::vector<std::string>& chunkFiles)
+    {
+        const char* names[] = { "CalculateChunkSizes (cold)", "CalculateChunkSizes (warm)", "ChunkCatalog Refresh" };
+        for (int variant = 0; variant < 3; ++variant)
+        {
+            if (!Selected(options, names[variant]))
+            {
+                continue;
+            }
+
+            Samples samples;
+            ChunkCatalog::Instance().Clear();
+            Level::CalculateChunkSizes(chunkFiles);
+            for (int iteration = 0; iteration < options.iterations; ++iteration)
+            {
+                if (variant == 0)
+                {
+                    ChunkCatalog::Instance().Clear();
+                }
+
+                Stopwatch timer;
+                if (variant == 2)
+                {
+                    ChunkCatalog::Instance().Refresh();
+                }
+                else
+                {
+                    Level::CalculateChunkSizes(chunkFiles);
+                }
+                samples.Add(timer.Elapsed());
+            }
+            Report(names[variant], samples, 0.0, static_cast<double>(chunkFiles.size()));
+        }
+    }
+
+    void BenchAllocators(const BenchOptions& options)
+    {
+        const size_t allocationCount = 100000;
+        std::mt19937 rng(options.seed);
+        std::vector<size_t> sizes(allocationCount);
+        size_t totalBytes = 0;
+        for (auto& size : sizes)
+        {
+            size = 16 + rng() % 4080;
+            totalBytes += size + StackAllocator::DefaultAlignment;
+        }
+
+        std::vector<void*> pointers(allocationCount);
+        if (Selected(options, "StackAllocator"))
+        {
+            Samples samples;
+            StackAllocator allocator(totalBytes);
+            for (int iteration = 0; iteration < options.iterations; ++iteration)
+            {
+                Stopwatch timer;
+                size_t marker = allocator.GetMarker();
+                for (size_t i = 0; i < allocationCount; ++i)
+                {
+                    pointers[i] = allocator.Allocate(sizes[i]);
+                }
+                allocator.FreeToMarker(marker);
+                samples.Add(timer.Elapsed());
+            }
+            Report("StackAllocator alloc+free x100k", samples, 0.0, static_cast<double>(allocationCount));
+        }
+
+        if (Selected(options, "TlsfAllocator"))
+        {
+            Samples samples;
+            TlsfAllocator allocator(totalBytes + totalBytes / 8);
+            for (int iteration = 0; iteration < options.iterations; ++iteration)
+            {
+                Stopwatch timer;
+                for (size_t i = 0; i < allocationCount; ++i)
+                {
+                    pointers[i] = allocator.Allocate(sizes[i]);
+                }
+                for (size_t i = allocationCount; i > 0; --i)
+                {
+                    allocator.Free(pointers[i - 1]);
+                }
+                samples.Add(timer.Elapsed());
+            }
+            Report("TlsfAllocator alloc+free x100k", samples, 0.0, static_cast<double>(allocationCount));
+        }
+
+        if (Selected(options, "malloc"))
+        {
+            Samples samples;
+            for (int iteration = 0; iteration < options.iterations; ++iteration)
+            {
+                Stopwatch timer;
+                for (size_t i = 0; i < allocationCount; ++i)
+                {
+                    pointers[i] = malloc(sizes[i]);
+                }
+                for (size_t i = allocationCount; i > 0; --i)
+                {
+                    free(pointers[i - 1]);
+                }
+                samples.Add(timer.Elapsed());
+            }
+            Report("malloc alloc+free x100k", samples, 0.0, static_cast<double>(allocationCount));
+        }
+    }
+
+    void BenchObjectPool(const BenchOptions& options)
+    {
+        const size_t objectCount = 100000;
+        std::vector<FileChunk*> objects(objectCount);
+
+        if (Selected(options, "ObjectPool"))
+        {
+            Samples samples;
+            ObjectPool<FileChunk> pool(objectCount, false);
+            for (int iteration = 0; iteration < options.iterations; ++iteration)
+            {
+                Stopwatch timer;
+                for (size_t i = 0; i < objectCount; ++i)
+                {
+                    objects[i] = pool.Acquire();
+                }
+                for (size_t i = 0; i < objectCount; ++i)
+                {
+                    pool.Release(objects[i]);
+                }
+                samples.Add(timer.Elapsed());
+            }
+            Report("ObjectPool acquire+release x100k", samples, 0.0, static_cast<double>(objectCount));
+        }
+
+        if (Selected(options, "new/delete"))
+        {
+            Samples samples;
+            for (int iteration = 0; iteration < options.iterations; ++iteration)
+            {
+                Stopwatch timer;
+                for (size_t i = 0; i < objectCount; ++i)
+                {
+                    objects[i] = new FileChunk();
+                }
+                for (size_t i = 0; i < objectCount; ++i)
+                {
+                    delete objects[i];
+                }
+                samples.Add(timer.Elapsed());
+            }
+            Report("new/delete FileChunk x100k", samples, 0.0, static_cast<double>(objectCount));
+        }
+    }
+
+    // Accepts sizes such as 4096, 64K, 16M or 2G
+    size_t ParseSize(const std::string& text)
+    {
+        std::istringstream input(text);
+        double value = 0.0;
+        input >> value;
+        char unit = 0;
+        input >> unit;
+        switch (toupper(unit))
+        {
+        case 'K': value *= 1024.0; break;
+        case 'M': value *= 1024.0 * 1024.0; break;
+        case 'G': value *= 1024.0 * 1024.0 * 1024.0; break;
+        default: break;
+        }
+        return static_cast<size_t>(value);
+    }
+
+    void PrintUsage()
+    {
+        std::cout << "LevelBench [options]\n"
+            << "  --chunks N              number of chunk files (64)\n"
+            << "  --min-size S            smallest chunk, accepts K/M/G suffixes (64K)\n"
+            << "  --max-size S            largest chunk (1M)\n"
+            << "  --total-size S          scale chunk sizes to this total\n"
+            << "  --distribution D        uniform, lognormal or fixed (uniform)\n"
+            << "  --duplicates R          share of chunks repeating an earlier one, 0-1 (0)\n"
+            << "  --random R              share of incompressible 4K blocks, 0-1 (0.5)\n"
+            << "  --iterations N          samples per benchmark (5)\n"
+            << "  --seed N                generator seed (1)\n"
+            << "  --dir PATH              directory for generated files (bench_data)\n"
+            << "  --filter TEXT           only run benchmarks whose name contains TEXT\n";
+    }
+
+    bool ParseOptions(int argc, char* argv[], BenchOptions& options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string option = argv[i];
+            if (option == "--help" || i + 1 >= argc)
+            {
+                return false;
+            }
+
+            std::string value = argv[++i];
+            if (option == "--chunks") options.chunkCount = std::max<size_t>(1, std::stoul(value));
+            else if (option == "--min-size") options.minChunkSize = ParseSize(value);
+            else if (option == "--max-size") options.maxChunkSize = ParseSize(value);
+            else if (option == "--total-size") options.totalSize = ParseSize(value);
+            else if (option == "--distribution") options.distribution = value;
+            else if (option == "--duplicates") options.duplicateRatio = std::stod(value);
+            else if (option == "--random") options.randomFraction = std::stod(value);
+            else if (option == "--iterations") options.iterations = std::max(1, std::stoi(value));
+            else if (option == "--seed") options.seed = static_cast<unsigned int>(std::stoul(value));
+            else if (option == "--dir") options.workDir = value;
+            else if (option == "--filter") options.filter = value;
+            else return false;
+        }
+        options.maxChunkSize = std::max(options.minChunkSize, options.maxChunkSize);
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        PrintUsage();
+        return -1;
+    }
+
+    // Level logs every step, which would dominate the timings, only failures are kept
+    Logger::Instance().SetLevel(LogLevel::Warning);
+
+    std::ostream& out = std::cout;
+
+    std::vector<std::string> chunkFiles = GenerateChunks(options);
+    size_t totalSize = Level::CalculateTotalChunkSize(chunkFiles);
+    out << chunkFiles.size() << " chunks, " << totalSize / 1024 << " KB total, " << options.distribution << " sizes, "
+        << options.iterations << " iterations" << std::endl;
+    out << std::left << std::setw(40) << "benchmark" << std::right << std::setw(6) << "n"
+        << std::setw(12) << "p50 us" << std::setw(12) << "p90 us" << std::setw(12) << "p99 us" << std::setw(12) << "max us"
+        << std::setw(17) << "throughput" << std::setw(13) << "peak RSS" << std::endl;
+
+    BenchAddChunk(options, chunkFiles, totalSize, Level::ChunkIngestMode::Buffered, "AddChunk (buffered)");
+    BenchAddChunk(options, chunkFiles, totalSize, Level::ChunkIngestMode::Mapped, "AddChunk (mapped)");
+    BenchAddChunk(options, chunkFiles, totalSize, Level::ChunkIngestMode::Buffered, "AddChunk (buffered, prefetch 8)", 8);
+    BenchAssembly(options, chunkFiles, totalSize);
+    BenchLevelIO(options, chunkFiles, totalSize);
+    BenchChunkCatalog(options, chunkFiles);
+    BenchAllocators(options);
+    BenchObjectPool(options);
+
+    out << "Peak RSS: " << GetPeakRss() / (1024 * 1024) << " MB" << std::endl;
+    return 0;
+}
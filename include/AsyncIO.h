@@ -0,0 +1,96 @@
+#ifndef ASYNCIO_H
+#define ASYNCIO_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One file operation in a batch handed to AsyncIO
+struct IORequest
+{
+    enum class Type
+    {
+        Read,   // Read size bytes at offset into buffer
+        Write,  // Write size bytes from buffer at offset, the file is created if missing
+        Stat    // Query the file size and modification time
+    };
+
+    Type type;
+    std::string path;
+    void* buffer;
+    size_t size;
+    uint64_t offset;
+
+    // Bytes transferred for reads and writes, the file size for stats, negative on failure
+    int64_t result;
+
+    // Last modification time filled in by stats, in nanoseconds on an unspecified epoch, only good for comparisons
+    int64_t modifiedTime = 0;
+
+    static IORequest Read(const std::string& path, void* buffer, size_t size, uint64_t offset);
+    static IORequest Write(const std::string& path, const void* buffer, size_t size, uint64_t offset);
+    static IORequest Stat(const std::string& path);
+
+    bool Succeeded() const;
+};
+
+// Batched positional file I/O. On Linux a batch is submitted through io_uring,
+// elsewhere (or when io_uring is unavailable) it runs on a pool of pread/pwrite worker threads.
+class AsyncIO
+{
+public:
+    // workerCount 0 picks a worker count suited to the hardware
+    explicit AsyncIO(unsigned int workerCount = 0);
+    ~AsyncIO();
+
+    AsyncIO(const AsyncIO&) = delete;
+    AsyncIO& operator=(const AsyncIO&) = delete;
+
+    // Shared instance, its workers live for the whole process
+    static AsyncIO& Default();
+
+    // Runs every request of the batch and waits for all of them, false if any failed
+    bool Execute(std::vector<IORequest>& batch);
+
+    bool IsUsingIoUring() const;
+
+    // Runs one request on the calling thread
+    static void ExecuteSync(IORequest& request);
+
+private:
+    struct Batch
+    {
+        std::atomic<size_t> remaining;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+
+    struct Job
+    {
+        IORequest* request;
+        Batch* batch;
+    };
+
+    struct IoUring;
+
+    bool ExecuteOnPool(std::vector<IORequest>& batch);
+    void WorkerLoop();
+
+    std::vector<std::thread> workers;
+    std::deque<Job> jobs;
+    std::mutex jobMutex;
+    std::condition_variable jobAvailable;
+    bool stopping;
+
+    std::unique_ptr<IoUring> ring;
+    std::mutex ringMutex;
+};
+
+#endif // ASYNCIO_H
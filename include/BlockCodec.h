@@ -0,0 +1,21 @@
+#ifndef BLOCKCODEC_H
+#define BLOCKCODEC_H
+
+#include <cstddef>
+
+// Fast LZ77 block codec using the LZ4 block layout: token, literals, 16-bit offset, match length.
+// Blocks are self-contained, the decoder needs the exact uncompressed size.
+class BlockCodec
+{
+public:
+    // Largest output Compress can produce for srcSize input bytes
+    static size_t GetMaxCompressedSize(size_t srcSize);
+
+    // Compresses src into dst, returns the compressed size or 0 if it does not fit in dstCapacity
+    static size_t Compress(const void* src, size_t srcSize, void* dst, size_t dstCapacity);
+
+    // Decompresses a block into exactly dstSize bytes, false if the block is malformed or does not match dstSize
+    static bool Decompress(const void* src, size_t srcSize, void* dst, size_t dstSize);
+};
+
+#endif // BLOCKCODEC_H
@@ -0,0 +1,61 @@
+#ifndef CHUNKALLOCATOR_H
+#define CHUNKALLOCATOR_H
+
+#include <atomic>
+#include <cstddef>
+
+class JsonWriter;
+
+// Memory for chunk payloads, freed one block at a time in any order. Implementations are thread-safe,
+// a payload is freed on whichever thread drops the last reference to it.
+class ChunkAllocator
+{
+public:
+    // Alignment used when none is given, suitable for any scalar type
+    static const size_t DefaultAlignment = alignof(std::max_align_t);
+
+    struct Stats
+    {
+        size_t allocations;        // Successful Allocate calls
+        size_t frees;
+        size_t failedAllocations;  // Allocate calls that returned nullptr
+        size_t bytesInUse;         // Bytes held by live blocks
+        size_t highWaterMark;      // Largest bytesInUse seen
+        size_t capacity;           // Bytes reserved up front, 0 when every block comes straight from the system
+    };
+
+    virtual ~ChunkAllocator() = default;
+
+    // Returns nullptr when out of memory, alignment must be a power of two
+    virtual void* Allocate(size_t size, size_t alignment = DefaultAlignment) = 0;
+
+    // Takes a block returned by Allocate, nullptr is ignored
+    virtual void Free(void* block) = 0;
+
+    virtual Stats GetStats() const = 0;
+    virtual void WriteStatsJson(JsonWriter& json) const;
+
+protected:
+    // The Stats fields, for backends that add their own
+    static void WriteStatsFields(JsonWriter& json, const Stats& stats);
+};
+
+// Every block comes from the C heap, what the chunk store uses unless told otherwise
+class HeapChunkAllocator : public ChunkAllocator
+{
+public:
+    HeapChunkAllocator();
+
+    void* Allocate(size_t size, size_t alignment = DefaultAlignment) override;
+    void Free(void* block) override;
+    Stats GetStats() const override;
+
+private:
+    std::atomic<size_t> allocations;
+    std::atomic<size_t> frees;
+    std::atomic<size_t> failedAllocations;
+    std::atomic<size_t> bytesInUse;
+    std::atomic<size_t> highWaterMark;
+};
+
+#endif // CHUNKALLOCATOR_H
@@ -0,0 +1,53 @@
+#ifndef CHUNKCATALOG_H
+#define CHUNKCATALOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Process-wide cache of chunk file sizes. Files the catalog has not seen are statted in one AsyncIO batch,
+// later lookups are answered from memory until Refresh finds the file changed or it is invalidated.
+// Files that do not exist are not cached, they are statted again on every lookup. Sizes that chunk reads
+// depend on should be refreshed first, see Level::SetChunkManifest.
+class ChunkCatalog
+{
+public:
+    struct Entry
+    {
+        uint64_t size;
+        int64_t modifiedTime;  // From IORequest::modifiedTime
+    };
+
+    static ChunkCatalog& Instance();
+
+    ChunkCatalog(const ChunkCatalog&) = delete;
+    ChunkCatalog& operator=(const ChunkCatalog&) = delete;
+
+    // Size of each file in order, 0 for files that cannot be statted
+    std::vector<size_t> GetSizes(const std::vector<std::string>& paths);
+
+    // Re-stats every cataloged file in one batch and updates the entries whose size or modification time changed,
+    // returns their paths (files that are gone are dropped and returned too)
+    std::vector<std::string> Refresh();
+
+    // Same for the given files only, files not cataloged yet are added
+    std::vector<std::string> Refresh(const std::vector<std::string>& paths);
+
+    // Forgets one file, the next lookup stats it again
+    void Invalidate(const std::string& path);
+    void Clear();
+
+    bool Find(const std::string& path, Entry& entry) const;
+    size_t GetEntryCount() const;
+
+private:
+    ChunkCatalog() = default;
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+};
+
+#endif // CHUNKCATALOG_H
@@ -0,0 +1,109 @@
+#ifndef CHUNKPREFETCHER_H
+#define CHUNKPREFETCHER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class JsonWriter;
+
+// Reads chunk files ahead of their use on a background thread. Every file in the window gets a read-ahead hint
+// to the OS, and as many as fit the staging limit are read whole into staging buffers, which Take hands over
+// in place of a read. One thread schedules and takes, the reads run on AsyncIO::Default.
+class ChunkPrefetcher
+{
+public:
+    static const size_t DefaultStagingLimit = 64 * 1024 * 1024;
+
+    // A chunk file expected soon and its size. Files that will not be read through Take,
+    // such as ones that are memory-mapped, are only hinted.
+    struct Request
+    {
+        std::string path;
+        size_t size;
+        bool stage;
+    };
+
+    struct Stats
+    {
+        uint64_t hits;       // Take calls answered from staging
+        uint64_t misses;     // Take calls for files that were not staged (yet)
+        uint64_t hints;      // Files hinted to the OS
+        uint64_t wasted;     // Staged files dropped without being taken
+        uint64_t failed;     // Background reads that failed
+        uint64_t bytesStaged;
+        size_t stagingBytes; // Bytes staged or being read now
+    };
+
+    // window is the number of upcoming chunk files to work on, 0 turns prefetching off
+    explicit ChunkPrefetcher(size_t window, size_t stagingLimit = DefaultStagingLimit);
+    ~ChunkPrefetcher();
+
+    ChunkPrefetcher(const ChunkPrefetcher&) = delete;
+    ChunkPrefetcher& operator=(const ChunkPrefetcher&) = delete;
+
+    void SetWindow(size_t chunkCount);
+    size_t GetWindow() const;
+
+    // The chunk files expected next, nearest first. Only the first window of them are prefetched,
+    // staged files no longer in the list are dropped.
+    void Prefetch(const std::vector<Request>& upcoming);
+
+    // Moves a staged file's bytes out, waiting if its read is under way. False if the file was not staged or
+    // changed after it was read, the caller then reads it itself (a hinted file is likely in the OS cache by then).
+    bool Take(const std::string& path, std::vector<char>& bytes);
+
+    // Drops everything staged or queued
+    void Clear();
+
+    Stats GetStats() const;
+    void ResetStats();
+    void WriteStatsJson(JsonWriter& json) const;
+
+private:
+    enum class EntryState
+    {
+        QueuedHint,   // Waiting for the worker to hint it
+        QueuedRead,   // Waiting for the worker to hint and read it
+        Reading,      // Its bytes are being read, the entry must stay put
+        Hinted,
+        Staged,
+        Failed
+    };
+
+    struct Entry
+    {
+        EntryState state;
+        size_t size;
+        bool abandoned;  // Dropped while Reading, the worker erases it once the read is done
+        int64_t modifiedTime;  // Taken before the read, a file changed since is not handed out
+        std::vector<char> bytes;
+    };
+
+    void WorkerLoop();
+
+    // Drops an entry that is not being read, false for one that is
+    bool Drop(std::unordered_map<std::string, Entry>::iterator entry);
+
+    // Asks the OS to start reading the file into its cache
+    static void AdviseWillNeed(const std::string& path, size_t size);
+
+    mutable std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable readDone;
+    std::unordered_map<std::string, Entry> entries;
+    std::deque<std::string> queue;
+    std::thread worker;
+    bool stopping;
+    size_t window;
+    size_t stagingLimit;
+    Stats stats;
+};
+
+#endif // CHUNKPREFETCHER_H
@@ -0,0 +1,92 @@
+#ifndef CHUNKRESIDENCY_H
+#define CHUNKRESIDENCY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JsonWriter;
+
+// Least recently used order and byte budget of the chunk payloads a level holds in memory.
+// It only keeps the books, the level decides which chunks can go and how they come back. Every operation is O(1).
+class ChunkResidency
+{
+public:
+    struct Stats
+    {
+        uint64_t hits;       // Touch calls on a resident chunk
+        uint64_t faults;     // Inserts of a chunk that had been evicted
+        uint64_t evictions;
+        size_t residentBytes;
+        size_t residentChunks;
+        size_t peakResidentBytes;
+        size_t budget;       // 0 = unlimited
+    };
+
+    ChunkResidency();
+
+    // Bytes of payload the level may keep in memory, 0 for no limit
+    void SetBudget(size_t bytes);
+    size_t GetBudget() const;
+    bool IsOverBudget() const;
+
+    // Grows or shrinks the chunk count, chunks past the new count are dropped
+    void Resize(size_t chunkCount);
+
+    // Drops every chunk without counting evictions
+    void Clear();
+
+    // Marks a resident chunk as the most recently used, false if it is not resident
+    bool Touch(int chunkIndex);
+
+    // Records a chunk as resident with size bytes and the most recently used
+    void Insert(int chunkIndex, size_t size);
+
+    // The level let go of the chunk to stay within the budget, it can be faulted back in
+    void Evict(int chunkIndex);
+
+    // The chunk is gone for another reason, such as a new manifest
+    void Remove(int chunkIndex);
+
+    bool IsResident(int chunkIndex) const;
+    bool IsEvicted(int chunkIndex) const;
+
+    // Resident chunks from the least recently used up, -1 past the end
+    int GetLeastRecent() const;
+    int GetNewer(int chunkIndex) const;
+
+    size_t GetResidentBytes() const;
+
+    Stats GetStats() const;
+    void ResetStats();
+    void WriteStatsJson(JsonWriter& json) const;
+
+private:
+    // Links a chunk in as the newest and adds its bytes to the total, Unlink undoes both
+    void Link(int chunkIndex);
+    void Unlink(int chunkIndex);
+
+    enum class State : uint8_t
+    {
+        Absent,
+        Resident,
+        Evicted
+    };
+
+    // Doubly linked list through the chunk indices, oldest at head
+    std::vector<int> previous;
+    std::vector<int> next;
+    std::vector<size_t> sizes;
+    std::vector<State> states;
+    int head;
+    int tail;
+    size_t budget;
+    size_t residentBytes;
+    size_t residentChunks;
+    size_t peakResidentBytes;
+    uint64_t hits;
+    uint64_t faults;
+    uint64_t evictions;
+};
+
+#endif // CHUNKRESIDENCY_H
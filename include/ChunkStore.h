@@ -0,0 +1,123 @@
+#ifndef CHUNKSTORE_H
+#define CHUNKSTORE_H
+
+#include "ChunkAllocator.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// Process-wide store of chunk payloads keyed by content hash, chunks with identical bytes share one buffer
+class ChunkStore
+{
+public:
+    // Immutable payload, freed when the last chunk referring to it lets go
+    class Blob
+    {
+    public:
+        const void* GetData() const { return data; }
+        size_t GetSize() const { return size; }
+        uint64_t GetHash() const { return hash; }
+
+    private:
+        friend class ChunkStore;
+        Blob(uint64_t hash, size_t size, char* data) : data(data), size(size), hash(hash) {}
+
+        char* data;  // Owned, the deleter returns it to the allocator it came from
+        size_t size;
+        uint64_t hash;
+    };
+
+    // Blob memory handed out before its bytes are known, so a read or decoder can write straight into it.
+    // Commit turns it into a shared blob, dropping it uncommitted gives the memory back.
+    class PendingBlob
+    {
+    public:
+        PendingBlob() = default;
+        PendingBlob(PendingBlob&&) = default;
+        PendingBlob& operator=(PendingBlob&&) = default;
+        PendingBlob(const PendingBlob&) = delete;
+        PendingBlob& operator=(const PendingBlob&) = delete;
+
+        void* GetData() const { return blob ? blob->data : nullptr; }
+        size_t GetSize() const { return blob ? blob->size : 0; }
+        explicit operator bool() const { return blob != nullptr; }
+
+    private:
+        friend class ChunkStore;
+        explicit PendingBlob(std::shared_ptr<Blob> blob) : blob(std::move(blob)) {}
+
+        std::shared_ptr<Blob> blob;
+    };
+
+    // Store shared by every Level in the process
+    static ChunkStore& Instance();
+
+    // Returns the blob holding these bytes, copying them into a new blob only if no identical one is alive
+    std::shared_ptr<const Blob> Intern(const void* data, size_t size);
+
+    // Memory for a blob of size bytes, an empty PendingBlob if even the heap has none
+    PendingBlob Reserve(size_t size);
+
+    // Returns the blob holding the pending blob's bytes. An identical blob that is already alive is returned
+    // instead and the pending memory goes back to the allocator.
+    std::shared_ptr<const Blob> Commit(PendingBlob pending);
+
+    // 64-bit content hash (xxHash64), four independent lanes so wide chunks hash at memory speed
+    static uint64_t Hash(const void* data, size_t size, uint64_t seed = 0);
+
+    size_t GetBlobCount() const;
+    size_t GetStoredBytes() const;   // Bytes held by live blobs
+    size_t GetDedupHits() const;     // Intern calls answered with an existing blob
+
+    // Where new blobs get their bytes (default: the heap), blobs already stored go back to the allocator they came from
+    void SetAllocator(std::shared_ptr<ChunkAllocator> allocator);
+    std::shared_ptr<ChunkAllocator> GetAllocator() const;
+
+    // Blobs the allocator had no room for, they were put on the heap instead
+    size_t GetAllocatorFallbacks() const;
+
+private:
+    ChunkStore();
+
+    ChunkStore(const ChunkStore&) = delete;
+    ChunkStore& operator=(const ChunkStore&) = delete;
+
+    // One slice of the blob index, picked by hash so concurrent loads rarely wait on each other
+    struct Shard
+    {
+        struct Entry
+        {
+            const Blob* blob;  // Identifies the entry once the weak reference has expired
+            std::weak_ptr<const Blob> reference;
+        };
+
+        std::mutex mutex;
+        std::unordered_multimap<uint64_t, Entry> blobs;  // A blob's deleter erases its entry
+    };
+
+    static const size_t ShardCount = 16;
+    typedef std::array<Shard, ShardCount> ShardArray;
+
+    // The low hash bits pick the bucket inside a shard as well, the top ones are independent of them
+    static Shard& GetShard(ShardArray& shards, uint64_t hash) { return shards[static_cast<size_t>(hash >> 60) % ShardCount]; }
+
+    // Live blobs of the same hash and size, collected under the shard lock and compared after it
+    std::shared_ptr<const Blob> Find(uint64_t hash, const void* data, size_t size);
+
+    // Adds a filled blob to the index, unless an identical one was added since Find missed
+    std::shared_ptr<const Blob> Insert(std::shared_ptr<Blob> blob);
+
+    std::shared_ptr<ShardArray> shards;                // Shared with blob deleters
+    std::shared_ptr<std::atomic<size_t>> storedBytes;  // Shared with blob deleters
+    mutable std::mutex allocatorMutex;
+    std::shared_ptr<ChunkAllocator> allocator;
+    std::shared_ptr<ChunkAllocator> heapAllocator;     // Fallback when allocator is full
+    std::atomic<size_t> dedupHits;
+    std::atomic<size_t> allocatorFallbacks;
+};
+
+#endif // CHUNKSTORE_H
@@ -0,0 +1,19 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32C (Castagnoli). Uses the SSE4.2 or ARMv8 CRC instructions when the CPU has them,
+// a slicing-by-8 table otherwise.
+class Crc32c
+{
+public:
+    // Extends crc with size bytes, pass the previous result to checksum data in pieces
+    static uint32_t Compute(const void* data, size_t size, uint32_t crc = 0);
+
+    // Whether Compute runs on the CRC instructions
+    static bool IsHardwareAccelerated();
+};
+
+#endif // CRC32C_H
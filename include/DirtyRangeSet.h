@@ -0,0 +1,30 @@
+#ifndef DIRTYRANGESET_H
+#define DIRTYRANGESET_H
+
+#include <cstddef>
+#include <vector>
+
+// Sorted set of byte ranges [begin, end), overlapping and touching ranges are merged
+class DirtyRangeSet
+{
+public:
+    struct Range
+    {
+        size_t begin;
+        size_t end;
+    };
+
+    void Add(size_t begin, size_t end);
+    void Clear();
+
+    bool IsEmpty() const;
+    const std::vector<Range>& GetRanges() const;
+
+    // Total number of bytes covered by the ranges
+    size_t GetByteCount() const;
+
+private:
+    std::vector<Range> ranges;
+};
+
+#endif // DIRTYRANGESET_H
@@ -0,0 +1,74 @@
+#ifndef EPOCHDOMAIN_H
+#define EPOCHDOMAIN_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Epoch-based reclamation. Readers pin the current epoch without locks while they look at shared objects,
+// the writer retires an object it has replaced and the object is reclaimed once every reader that could still
+// see it has unpinned. Readers may be on any thread, the writer side is used by one thread at a time.
+class EpochDomain
+{
+public:
+    // Keeps objects retired after Pin alive until it is destroyed
+    class Guard
+    {
+    public:
+        Guard(Guard&& other);
+        ~Guard();
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        Guard& operator=(Guard&&) = delete;
+
+    private:
+        friend class EpochDomain;
+        Guard(EpochDomain* domain, size_t slot) : domain(domain), slot(slot) {}
+
+        EpochDomain* domain;
+        size_t slot;
+    };
+
+    EpochDomain();
+
+    // Runs every reclaim still waiting, no reader may be pinned
+    ~EpochDomain();
+
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    // Reader side: load the shared pointer after pinning
+    Guard Pin();
+
+    // Writer side: the object must already be unreachable for new readers, reclaim runs when the old ones are gone
+    void Retire(std::function<void()> reclaim);
+
+    // Runs the reclaims no pinned reader can still need, returns how many are left waiting
+    size_t Reclaim();
+
+private:
+    // Concurrent readers beyond this wait for a free slot
+    static const size_t SlotCount = 64;
+
+    // One reader per slot, a cache line each so readers on different cores do not share one
+    struct Slot
+    {
+        std::atomic<uint64_t> epoch;  // 0 = free
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    struct Retired
+    {
+        uint64_t epoch;
+        std::function<void()> reclaim;
+    };
+
+    Slot slots[SlotCount];
+    std::atomic<uint64_t> epoch;
+    std::vector<Retired> retired;
+};
+
+#endif // EPOCHDOMAIN_H
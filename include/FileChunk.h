@@ -10,13 +10,19 @@ public:
 
     void LoadData(void* chunkData, size_t chunkSize);
 
+    // Points the chunk at memory it must not write to, such as a read-only file mapping
+    void LoadView(const void* chunkData, size_t chunkSize);
+
     void* GetData();
 
     size_t GetSize();
 
+    bool IsReadOnly() const;
+
 private:
     void* data;
     size_t size;
+    bool readOnly;
 };
 
 #endif // FILECHUNK_H
@@ -0,0 +1,92 @@
+#ifndef IMAGEVIEWER_H
+#define IMAGEVIEWER_H
+
+#include "SDLManager.h"
+#include "DirtyRangeSet.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Runs the image window on its own thread so the console menu never waits on it. SDL is initialized once when
+// the thread starts and shut down by Stop, closing the window (X or the close button) only hides it.
+// The thread sleeps in SDL_WaitEvent and redraws only when the window is exposed or resized or the image changed.
+// SDL calls happen on the viewer thread, except SDL_PushEvent, which SDL allows from any thread and which Post and
+// Show use to wake it. Nothing else in the process may use SDL while it runs.
+// Set SDL_VIDEODRIVER=dummy to run it offscreen.
+class ImageViewer
+{
+public:
+    ImageViewer();
+    ~ImageViewer();
+
+    ImageViewer(const ImageViewer&) = delete;
+    ImageViewer& operator=(const ImageViewer&) = delete;
+
+    // Starts the viewer thread and waits until SDL is up, false if it could not be initialized
+    bool Start(const std::string& windowTitle);
+    void Stop();
+    bool IsRunning() const;
+
+    // The calls below come from one thread. Each copies what the viewer needs and returns without waiting for it.
+
+    // Sends the changed bytes of a TGA image in memory. The first image, and one of a different size, is sent whole.
+    void UpdateImage(const void* imageData, size_t imageSize, const DirtyRangeSet& changes);
+
+    // Shows a TGA file from disk instead
+    void ShowFile(const std::string& imagePath);
+
+    // Puts the window on screen and in front
+    void Show();
+
+    // The window is on screen, false once the user closed it
+    bool IsVisible() const;
+
+    // Frames presented so far, stays put while nothing changes
+    uint64_t GetFrameCount() const;
+
+private:
+    // One handoff from the caller to the viewer thread
+    struct Frame
+    {
+        std::string imagePath;     // Set when the image comes from a file
+        bool replace = false;      // bytes hold the whole image, otherwise the bytes of each range of changes in order
+        size_t imageSize = 0;
+        DirtyRangeSet changes;
+        std::vector<char> bytes;
+    };
+
+    void Run();
+
+    // Applies the pending frame and a pending Show, true if the window needs a redraw
+    bool ApplyPending();
+
+    // Replaces the pending frame, merging in one the viewer thread has not picked up yet
+    void Post(Frame* frame, const void* imageData);
+
+    // Wakes the viewer thread out of SDL_WaitEvent
+    void Wake();
+
+    std::thread thread;
+    std::string windowTitle;
+    Uint32 wakeEvent;
+    std::atomic<bool> running;
+    std::atomic<bool> stopping;
+    std::atomic<bool> visible;
+    std::atomic<bool> showRequested;
+    std::atomic<uint64_t> frameCount;
+
+    // Single slot, the caller swaps frames in and the viewer thread swaps them out
+    std::atomic<Frame*> pending;
+
+    // Caller side, what the viewer will hold once it has applied everything posted
+    size_t postedSize;
+
+    // Viewer thread side
+    SDLManager sdlManager;
+    std::vector<char> image;  // Copy of the image behind the texture, patched by each frame
+};
+
+#endif // IMAGEVIEWER_H
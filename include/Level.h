@@ -4,29 +4,111 @@
 #include "StackAllocator.h"
 #include "ObjectPool.h"
 #include "FileChunk.h"
+#include "Asset.h"
+#include "MappedFile.h"
+#include "LevelFormat.h"
+#include "DirtyRangeSet.h"
+#include "LevelJournal.h"
+#include "ChunkStore.h"
+#include "ChunkResidency.h"
+#include "Metrics.h"
+#include "EpochDomain.h"
+#include "ChunkPrefetcher.h"
+#include <atomic>
+#include <cstdint>
 #include <vector>
 #include <string>
-#include <stack>
+#include <memory>
+#include <fstream>
 
+// Counters and latencies of the Level pipeline, also updated from worker threads
+struct LevelStats
+{
+    std::atomic<uint64_t> bytesRead{ 0 };     // Chunk files and level files
+    std::atomic<uint64_t> bytesWritten{ 0 };  // Images and level files
+    std::atomic<uint64_t> chunksAdded{ 0 };
+    std::atomic<uint64_t> chunksRemoved{ 0 };
+    std::atomic<uint64_t> chunksLoaded{ 0 };   // Read back from level files
+    std::atomic<uint64_t> corruptChunks{ 0 };  // Failed checksum or decompression
 
-class FileChunk {
-public:
-    size_t GetSize() const { return size; }
-private:
-    size_t size;
+    LatencyHistogram chunkOpen;    // Opening or mapping a chunk's file
+    LatencyHistogram chunkRead;    // Reading one chunk's bytes
+    LatencyHistogram chunkCopy;    // Copying one chunk into the image buffer
+    LatencyHistogram chunkDecode;  // Checksum and decompression of one level file payload
+    LatencyHistogram batchRead;    // One AsyncIO batch of level file payloads
+    LatencyHistogram assembly;     // Whole AssembleChunks* calls
+    LatencyHistogram levelLoad;
+    LatencyHistogram levelSave;
+    LatencyHistogram imageSave;
+
+    void Reset();
+};
+
+// Chunk table of a level at one point in time, as readers on other threads see it. It never changes once published.
+// Chunks are kept in fixed-size pages, a table shares every page an edit did not touch with the table before it.
+struct LevelChunkTable
+{
+    struct Chunk
+    {
+        size_t offset;  // Slot in the image buffer
+        size_t size;
+        bool loaded;
+        std::shared_ptr<const void> payload;  // The chunk's bytes, null if they only live in the image buffer or were evicted
+    };
+
+    typedef std::vector<Chunk> Page;
+    static const size_t PageSize = 256;  // Chunks per page, the last page may hold fewer
+
+    uint64_t version;   // Goes up with every published edit, 0 before the first one
+    size_t imageSize;   // 0 without an image buffer
+    size_t chunkCount;
+    std::vector<std::shared_ptr<const Page>> pages;
+
+    size_t GetChunkCount() const { return chunkCount; }
+    const Chunk& GetChunk(size_t chunkIndex) const { return (*pages[chunkIndex / PageSize])[chunkIndex % PageSize]; }
 };
 
 class Level
 {
 public:
-    Level() : totalSize(0), currentOffset(0), imageBuffer(nullptr) {}
+    // How AddChunk brings chunk bytes into memory
+    enum class ChunkIngestMode
+    {
+        Buffered,  // Read into memory of the shared ChunkStore, then copied into the image buffer
+        Mapped     // Memory-mapped as a read-only view, copied into the image buffer once
+    };
+
+    // Lock-free read access to the chunk table, see ReadChunkTable
+    class ChunkTableView
+    {
+    public:
+        const LevelChunkTable& operator*() const { return *table; }
+        const LevelChunkTable* operator->() const { return table; }
+
+    private:
+        friend class Level;
+        ChunkTableView(EpochDomain::Guard guard, const LevelChunkTable* table) : guard(std::move(guard)), table(table) {}
+
+        EpochDomain::Guard guard;
+        const LevelChunkTable* table;
+    };
+
+    Level() : imageBuffer(nullptr), totalSize(0) {}
     Level(size_t totalSize);
     ~Level();
 
-    std::stack<std::string> undoStack;
+    // Writes a version 2 level file, compress stores each chunk as a BlockCodec block when that makes it smaller
+    bool SaveLevel(const std::string& fileName, bool compress = false);
+    // Loads the chunk table of a level file, payloads are read on demand by LoadChunk (version 1 files are read in full)
+    bool LoadLevel(const std::string& fileName, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool, ObjectPool<Asset>& assetPool);
+
+    // Returns a loaded chunk, reading its payload from the level file the first time it is asked for
+    FileChunk* LoadChunk(int chunkIndex, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool);
 
-    bool SaveLevel(const std::string& fileName);
-    bool LoadLevel(const std::string& fileName, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool, ObjectPool<Asset>& assetPool);  // for loading the chunks back
+    // Loads every chunk still in the level file, the payloads are read in one batch and decompressed in parallel
+    // on the shared WorkerPool (workerCount 0 uses all of it, the calling thread included). Under a residency budget
+    // only as many as fit are loaded.
+    bool LoadAllChunks(StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool, unsigned int workerCount = 0);
 
     // Creates the image buffer with the given total size
     void CreateImageBuffer(size_t totalSize);
@@ -37,26 +119,103 @@ public:
     // Assemble chunks from chunk files and write to output image
     bool AssembleChunks(const std::vector<std::string>& chunkFiles, StackAllocator& allocator, ObjectPool<FileChunk>& pool, const std::string& outputImagePath, ObjectPool<Asset>& assetPool );
 
+    // Assemble chunks with one batch of AsyncIO reads, each chunk is read straight into its slot in the image buffer
+    // (workerCount 0 shares AsyncIO::Default, otherwise a dedicated backend with that many fallback workers is used)
+    bool AssembleChunksParallel(const std::vector<std::string>& chunkFiles, ObjectPool<FileChunk>& fileChunkPool, const std::string& outputImagePath, unsigned int workerCount = 0);
+
+    // Assemble chunks without an image buffer, each chunk file is piped to the output image through
+    // bufferCount buffers of bufferSize bytes, so memory use does not depend on the image size
+    bool AssembleChunksStreaming(const std::vector<std::string>& chunkFiles, ObjectPool<FileChunk>& fileChunkPool, const std::string& outputImagePath, size_t bufferSize = 1 << 20, size_t bufferCount = 4);
+
     // Statically calculate total chunk size
     static size_t CalculateTotalChunkSize(const std::vector<std::string>& chunkFiles);
 
+    // Statically calculate the size of every chunk file (0 for files that cannot be opened) through ChunkCatalog,
+    // files it has not seen are statted in one batch and the rest come from memory
+    static std::vector<size_t> CalculateChunkSizes(const std::vector<std::string>& chunkFiles);
+
+    // Checks a level file's structure and every payload checksum without loading it, on up to workerCount threads
+    // of the shared WorkerPool (0 uses all of them)
+    static bool VerifyLevel(const std::string& fileName, unsigned int workerCount = 0);
+
+    // Reads a chunk manifest, one chunk file path per line
+    static bool ReadChunkManifest(const std::string& manifestPath, std::vector<std::string>& chunkFiles);
+
+    // Sets the level's chunk files, one chunk slot per file laid out back to back in the image buffer.
+    // The files are re-statted first, so the slots match them as they are now. Chunks of the previous
+    // manifest are returned to the pool.
+    void SetChunkManifest(const std::vector<std::string>& chunkFiles, ObjectPool<FileChunk>& fileChunkPool);
+
     // Adds a chunk to the image buffer
-    bool AddChunk(int chunkIndex, const std::string& chunkFile, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool, ObjectPool<Asset>& assetPool, std::stack<std::string>& undoStack);
+    bool AddChunk(int chunkIndex, const std::string& chunkFile, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool, ObjectPool<Asset>& assetPool);
     
-    // Removes a chunk from the image buffer
-    void RemoveChunk(int chunkIndex);
+    // Selects how AddChunk ingests chunk files
+    void SetIngestMode(ChunkIngestMode mode);
+    ChunkIngestMode GetIngestMode() const;
+
+    // Removes a chunk from the image buffer, its FileChunk goes back to the pool and its payload is only kept by the journal.
+    // A chunk not read yet, or evicted, is loaded first so the journal keeps its real bytes.
+    void RemoveChunk(int chunkIndex, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool);
+
+    // Undo/redo chunk adds and removes from the bytes kept in the journal, chunk files are only read
+    // to capture a chunk that was never loaded or has been evicted
+    bool Undo(StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool);
+    bool Redo(StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool);
+    size_t GetUndoDepth() const;
+    size_t GetRedoDepth() const;
+
+    // Pipeline counters since construction or the last ResetStats
+    const LevelStats& GetStats() const;
+    void ResetStats();
 
-    // Save the assembled image to a file
+    // Writes the stats, undo/redo depth and chunk store totals as one JSON object
+    void WriteStatsJson(JsonWriter& json) const;
+
+    // Bytes of chunk payloads kept in memory, 0 for no limit. Past the budget the least recently used chunks
+    // that can be read again (from the level file or their chunk file) are let go, LoadChunk faults them back in
+    // and SaveLevel copies them from disk. The image buffer is not part of the budget.
+    void SetResidencyBudget(size_t bytes);
+    const ChunkResidency& GetResidency() const;
+
+    // Evicts down to the budget now instead of when the next chunk comes in
+    void TrimResidency(ObjectPool<FileChunk>& fileChunkPool);
+
+    // Chunk files to read ahead once chunks are added or faulted in sequence (AssembleChunks always is), 0 turns
+    // prefetching off. Up to stagingLimit bytes are read on a background thread, files past it only get an OS hint.
+    void SetPrefetchWindow(size_t chunkCount, size_t stagingLimit = ChunkPrefetcher::DefaultStagingLimit);
+    size_t GetPrefetchWindow() const;
+
+    // Journal memory for chunk copies, further copies spill to the spill file
+    void SetJournalMemoryCap(size_t bytes);
+    void SetJournalSpillFile(const std::string& fileName);
+
+    // Save the assembled image to a file, rewriting all of it
     bool SaveImage(const std::string& outputImagePath);
 
+    // Save only the byte ranges changed since the image was last saved to this file, falls back to SaveImage
+    bool SaveImageIncremental(const std::string& outputImagePath);
+
+    // Snapshot of the chunk table that any thread can take without locks while the level is edited on its own thread.
+    // Each edit publishes a new table when it is done, so the view never shows half an edit and stays unchanged
+    // while it lives. Keep views short, tables they pin are only freed after them.
+    ChunkTableView ReadChunkTable() const;
+
     // Gets image buffer in main loop
     void* GetImageBuffer() const;
+    size_t GetImageSize() const;
+
+    // Moves out the image buffer byte ranges changed since the last call, for viewers that update in place
+    void TakeImageChanges(DirtyRangeSet& changes);
 
     int GetCurrentChunkIndex() const;
 
-    // Getters for chunk information
+    // Getters for chunk information, O(1) through the chunk offset table
     void* GetChunkStart(int chunkIndex);
     size_t GetChunkSize(int chunkIndex);
+    size_t GetChunkCount() const;
+
+    // Image size needed to hold every chunk slot
+    size_t GetRequiredImageSize() const;
 
     // Status to track if a chunk is loaded or removed
     bool IsChunkLoaded(int chunkIndex) const;
@@ -73,14 +232,106 @@ public:
 
 
 private:
+    // Publishes the chunk table when the outermost edit in progress ends. An update for one chunk only has its
+    // page copied, any other update lays out the whole table again.
+    class TableUpdate
+    {
+    public:
+        explicit TableUpdate(Level& level) : level(level)
+        {
+            ++level.tableUpdateDepth;
+            level.tableLayoutChanged = true;
+        }
+        TableUpdate(Level& level, int chunkIndex) : level(level)
+        {
+            ++level.tableUpdateDepth;
+            level.changedTablePages.push_back(static_cast<size_t>(chunkIndex) / LevelChunkTable::PageSize);
+        }
+        ~TableUpdate()
+        {
+            if (--level.tableUpdateDepth == 0)
+            {
+                level.PublishChunkTable();
+            }
+        }
+
+    private:
+        Level& level;
+    };
+
+    // Publishes a chunk table for readers, built from the pages that changed and the ones of the last table,
+    // and retires the table they saw before
+    void PublishChunkTable();
+
+    // Copies one page of chunks from the level's own state
+    std::shared_ptr<const LevelChunkTable::Page> BuildChunkTablePage(size_t page) const;
+
+    // Reads a version 1 level file, every record is loaded sequentially
+    bool LoadLevelV1(std::ifstream& file, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool, ObjectPool<Asset>& assetPool);
+
+    // Zeros a chunk's slot in the image buffer, capturing its bytes in the command first (loading the chunk
+    // if it has no FileChunk), then lets go of the chunk's FileChunk and payload
+    bool ClearChunkSlot(int chunkIndex, LevelJournal::Command& command, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool);
+
+    // Copies the command's bytes back into the chunk's slot, a chunk without a FileChunk gets one viewing the slot.
+    // The bytes are always the chunk's own, ClearChunkSlot never captures a slot that was not filled
+    bool RestoreChunkSlot(int chunkIndex, LevelJournal::Command& command, ObjectPool<FileChunk>& fileChunkPool);
+
+    // Returns every FileChunk the level holds to the pool
+    void ReleaseChunks(ObjectPool<FileChunk>& fileChunkPool);
+
+    // Grows or shrinks every per-chunk table to chunkCount entries
+    void ResizeChunkTable(size_t chunkCount);
+
+    // Recomputes chunk slot offsets from the chunk sizes, starting at fromIndex
+    void RebuildChunkOffsets(size_t fromIndex);
+
+    // Records a write to the image buffer for both the next incremental save and the viewer
+    void MarkImageChanged(size_t begin, size_t end);
+
+    // Reads a chunk file straight into memory of the shared ChunkStore
+    std::shared_ptr<const ChunkStore::Blob> ReadChunkFile(int chunkIndex, const std::string& chunkFile);
+
+    // Chunks can be evicted when their payload can be read again and the FileChunk came from the pool
+    bool CanEvictChunk(int chunkIndex, ObjectPool<FileChunk>& fileChunkPool) const;
+    void EvictChunk(int chunkIndex, ObjectPool<FileChunk>& fileChunkPool);
+
+    // Evicts the least recently used chunks other than keepIndex until the payloads fit the budget
+    void EnforceResidencyBudget(ObjectPool<FileChunk>& fileChunkPool, int keepIndex = -1);
+
+    // Records an access to a chunk, and when it follows the previous one hands the chunk files that have
+    // to be read next to the prefetcher. Only the next few windows of chunks are looked at.
+    void PrefetchAfter(int chunkIndex);
+
     std::vector<FileChunk*> fileChunks;
     std::vector<FileChunk*> chunkPointers;
     void* imageBuffer;
     size_t totalSize;
-    size_t currentOffset = 0;  // Current offset in image buffer      
     std::vector<bool> chunkStatus; // Tracks if chunks are loaded
+    std::vector<size_t> chunkSizes;   // Slot size of each chunk
+    std::vector<size_t> chunkOffsets; // Slot offset of each chunk in the image buffer
     int currentChunkIndex;
     std::vector<std::string> chunkFiles;
+    ChunkIngestMode ingestMode = ChunkIngestMode::Buffered;
+    std::vector<std::shared_ptr<MappedFile>> chunkMappings;  // Mappings backing chunks ingested in Mapped mode, shared with readers
+    std::vector<std::shared_ptr<const ChunkStore::Blob>> chunkBlobs;  // Shared payloads backing buffered and loaded chunks
+    std::string levelFileName;                // Level file backing chunks that are not loaded yet
+    std::vector<LevelChunkEntry> levelTable;  // Chunk table of levelFileName by chunk index (offset 0 = not stored)
+    std::string savedImagePath;               // Image file that matches the buffer outside of dirtyRanges
+    DirtyRangeSet dirtyRanges;                // Image buffer bytes changed since the last save to savedImagePath
+    DirtyRangeSet imageChanges;               // Image buffer bytes changed since the last TakeImageChanges
+    LevelJournal journal;                     // Undo/redo history of chunk edits
+    ChunkResidency residency;                 // Which chunk payloads are in memory, in least recently used order
+    std::vector<uint32_t> evictedChecksums;   // CRC-32C of evicted payloads that come back from their chunk file
+    std::unique_ptr<ChunkPrefetcher> prefetcher;  // Null while prefetching is off
+    int lastAccessIndex = -2;                 // Chunk of the last add or load, for spotting sequential runs
+    std::atomic<const LevelChunkTable*> publishedTable{ nullptr };  // What ReadChunkTable returns
+    mutable EpochDomain tableEpochs;          // Frees replaced tables once no reader holds them
+    uint64_t tableVersion = 0;
+    int tableUpdateDepth = 0;
+    bool tableLayoutChanged = true;           // The next published table builds every page
+    std::vector<size_t> changedTablePages;    // Pages the next published table builds, duplicates allowed
+    LevelStats stats;
 };
 
 #endif // LEVEL_H
@@ -0,0 +1,49 @@
+#ifndef LEVELFORMAT_H
+#define LEVELFORMAT_H
+
+#include <cstdint>
+
+// Layout of a version 2 level file (little-endian):
+//   LevelFileHeader
+//   LevelChunkEntry[chunkCount]  (chunk table, at tableOffset)
+//   chunk payloads, at the offsets recorded in the table
+// Version 1 files have no header and are a sequence of bare [size_t size][bytes] records.
+
+const uint32_t LevelFileMagic = 0x324C564C;  // "LVL2"
+const uint32_t LevelFileVersion = 2;
+
+// Largest chunk index a level file may hold, bounds the table a corrupt file can make a reader allocate
+const uint32_t LevelMaxChunkIndex = 1u << 20;
+
+// Per-chunk flags stored in the chunk table
+enum LevelChunkFlags : uint32_t
+{
+    LevelChunkFlag_None = 0,
+    LevelChunkFlag_Compressed = 1 << 0,  // Payload is a BlockCodec block of storedSize bytes
+    LevelChunkFlag_Checksum = 1 << 1,    // checksum holds the CRC-32C of the storedSize payload bytes
+    LevelChunkFlag_Empty = 1 << 2        // Slot without a payload (a removed chunk), offset and storedSize are 0
+};
+
+#pragma pack(push, 1)
+struct LevelFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t chunkCount;
+    uint32_t entrySize;    // Size of one table entry, readers zero-fill fields they do not know
+    uint64_t tableOffset;
+};
+
+struct LevelChunkEntry
+{
+    uint32_t index;        // Chunk index the payload belongs to
+    uint32_t flags;        // LevelChunkFlags
+    uint64_t offset;       // Payload offset from the start of the file, never 0 for a stored chunk, 0 for an empty one
+    uint64_t size;         // Chunk size in bytes
+    uint64_t storedSize;   // Payload size in the file, 0 in files written before compression means size
+    uint32_t checksum;     // CRC-32C of the stored payload, valid with LevelChunkFlag_Checksum
+    uint32_t reserved;
+};
+#pragma pack(pop)
+
+#endif // LEVELFORMAT_H
@@ -0,0 +1,106 @@
+#ifndef LEVELJOURNAL_H
+#define LEVELJOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class LevelCommandType
+{
+    AddChunk,
+    RemoveChunk
+};
+
+// Undo/redo history of chunk edits, holding the chunk bytes needed to replay them without disk reads
+class LevelJournal
+{
+public:
+    // Where a command's chunk bytes live
+    enum class PayloadStorage
+    {
+        None,       // Not captured yet
+        Reference,  // Bytes owned by the level, valid until Detach is called for them, or shared with the command
+        Copy,       // Bytes copied into journal memory
+        Spilled     // Bytes written to the spill file, used once the memory cap is reached
+    };
+
+    struct Command
+    {
+        LevelCommandType type;
+        int chunkIndex;
+        PayloadStorage storage;
+        size_t size;
+        const void* reference;
+        std::shared_ptr<const void> owner;  // Keeps the referenced bytes alive, null while the level owns them
+        std::vector<char> copy;
+        uint64_t spillOffset;
+    };
+
+    LevelJournal();
+    ~LevelJournal();
+
+    LevelJournal(const LevelJournal&) = delete;
+    LevelJournal& operator=(const LevelJournal&) = delete;
+
+    // Bytes of chunk copies kept in memory before further copies spill to disk
+    void SetMemoryCap(size_t bytes);
+    void SetSpillFile(const std::string& fileName);
+
+    // Records a new command and clears the redo history
+    Command& Push(LevelCommandType type, int chunkIndex);
+
+    // Drops the newest command, used when it could not be applied
+    void Discard();
+
+    // Moves the newest command to the other history and returns it, nullptr when there is none
+    Command* Undo();
+    Command* Redo();
+
+    // Keeps a reference to bytes owned by the level. With an owner the command shares the bytes,
+    // the level may let go of them and Detach leaves the command alone.
+    void KeepReference(Command& command, const void* data, size_t size, std::shared_ptr<const void> owner = nullptr);
+
+    // Copies the bytes into journal memory, or into the spill file past the memory cap
+    bool KeepCopy(Command& command, const void* data, size_t size);
+
+    // Reads a command's bytes into destination
+    bool ReadPayload(const Command& command, void* destination);
+
+    // Called before the level frees or overwrites data, commands referencing it take their own copy
+    void Detach(const void* data);
+
+    // Drops all history
+    void Clear();
+
+    size_t GetUndoDepth() const;
+    size_t GetRedoDepth() const;
+    size_t GetMemoryUsed() const;
+
+    // Bytes the spill file spans, freed ranges inside it are reused by later spills
+    uint64_t GetSpillSize() const;
+
+private:
+    void DropPayload(Command& command);
+    void ClearCommands(std::vector<Command>& commands);
+
+    // Takes size bytes of the spill file, reusing a freed range before growing the file
+    uint64_t AllocateSpill(size_t size);
+
+    // Returns a range to the free ranges, the file is cut back when the range was at its end
+    void FreeSpill(uint64_t offset, uint64_t size);
+
+    std::vector<Command> undoCommands;  // Newest command last
+    std::vector<Command> redoCommands;  // Most recently undone command last
+    size_t memoryCap;
+    size_t memoryUsed;
+    std::string spillFileName;
+    std::fstream spillFile;
+    uint64_t spillEnd;
+    std::map<uint64_t, uint64_t> spillFreeRanges;  // Offset to size of spill file ranges no command uses, never touching spillEnd
+};
+
+#endif // LEVELJOURNAL_H
@@ -0,0 +1,88 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+
+enum class LogLevel
+{
+    Debug,
+    Info,
+    Warning,
+    Error
+};
+
+// Asynchronous logger, callers copy the message into a lock-free ring and a background thread
+// writes it out, flushing once per batch instead of once per line.
+// Debug and Info go to std::cout, Warning and Error to std::cerr.
+class Logger
+{
+public:
+    static const size_t RingCapacity = 1024;    // Entries, a power of two
+    static const size_t MaxMessageSize = 480;   // Longer messages are truncated
+
+    static Logger& Instance();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    // Queues a message, waits for a free entry when the ring is full so nothing is lost
+    void Write(LogLevel level, const std::string& message);
+
+    // Blocks until every message queued so far has been written and flushed
+    void Flush();
+
+    // Messages below the level are dropped before they are formatted
+    void SetLevel(LogLevel level);
+    bool IsEnabled(LogLevel level) const;
+
+private:
+    struct Entry
+    {
+        std::atomic<size_t> sequence;
+        LogLevel level;
+        uint32_t length;
+        char text[MaxMessageSize];
+    };
+
+    Logger();
+    ~Logger();
+
+    void Drain();
+
+    std::unique_ptr<Entry[]> ring;
+    std::atomic<size_t> enqueuePosition;
+    std::atomic<size_t> flushedPosition;  // Every message before this one has been written
+    std::atomic<int> minLevel;
+    std::atomic<bool> stopping;
+    std::thread drainThread;
+};
+
+#define LEVEL_LOG(level, expression) \
+    do \
+    { \
+        if (Logger::Instance().IsEnabled(level)) \
+        { \
+            std::ostringstream logStream; \
+            logStream << expression; \
+            Logger::Instance().Write(level, logStream.str()); \
+        } \
+    } while (0)
+
+// Debug statements only exist in debug builds, or when LEVEL_LOG_DEBUG is defined
+#if !defined(NDEBUG) || defined(LEVEL_LOG_DEBUG)
+#define LOG_DEBUG(expression) LEVEL_LOG(LogLevel::Debug, expression)
+#else
+#define LOG_DEBUG(expression) do {} while (0)
+#endif
+
+#define LOG_INFO(expression) LEVEL_LOG(LogLevel::Info, expression)
+#define LOG_WARNING(expression) LEVEL_LOG(LogLevel::Warning, expression)
+#define LOG_ERROR(expression) LEVEL_LOG(LogLevel::Error, expression)
+
+#endif // LOGGER_H
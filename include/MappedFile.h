@@ -0,0 +1,37 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Maps the file into memory, returns false if it cannot be opened or mapped
+    bool Open(const std::string& fileName);
+
+    // Unmaps the file
+    void Close();
+
+    const void* GetData() const;
+    size_t GetSize() const;
+    bool IsOpen() const;
+
+private:
+    const void* data;
+    size_t size;
+    bool open;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+};
+
+#endif // MAPPEDFILE_H
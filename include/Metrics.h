@@ -0,0 +1,109 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Minimal streaming JSON writer, commas and nesting are tracked for the caller
+class JsonWriter
+{
+public:
+    JsonWriter& BeginObject();
+    JsonWriter& EndObject();
+    JsonWriter& BeginArray();
+    JsonWriter& EndArray();
+
+    // Names the next value inside an object
+    JsonWriter& Key(const std::string& name);
+
+    JsonWriter& Value(const std::string& value);
+    JsonWriter& Value(const char* value);
+    JsonWriter& Value(bool value);
+    JsonWriter& Value(int value);
+    JsonWriter& Value(long value);
+    JsonWriter& Value(long long value);
+    JsonWriter& Value(unsigned int value);
+    JsonWriter& Value(unsigned long value);
+    JsonWriter& Value(unsigned long long value);
+    JsonWriter& Value(double value);
+
+    std::string ToString() const;
+
+private:
+    // Writes the comma before a new element when it is not the first in its container
+    void BeginElement();
+
+    std::ostringstream out;
+    std::vector<bool> hasElements;  // One entry per open container
+    bool afterKey = false;
+};
+
+// Latency histogram with power-of-two nanosecond buckets, safe to record from several threads
+class LatencyHistogram
+{
+public:
+    static const int BucketCount = 48;  // Bucket i holds [2^i, 2^(i+1)) ns, the last one everything longer
+
+    LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void Record(uint64_t nanoseconds);
+    void Reset();
+
+    uint64_t GetCount() const;
+    uint64_t GetTotalNanoseconds() const;
+    uint64_t GetMaxNanoseconds() const;
+
+    // Upper bound of the bucket holding the given percentile, 0 when nothing was recorded
+    uint64_t GetPercentileNanoseconds(double percentile) const;
+
+    // Writes count, total, mean, p50/p90/p99 and max in microseconds
+    void WriteJson(JsonWriter& json) const;
+
+private:
+    std::atomic<uint64_t> buckets[BucketCount];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> totalNanoseconds;
+    std::atomic<uint64_t> maxNanoseconds;
+};
+
+// Records the time from construction to destruction into a histogram
+class ScopedLatency
+{
+public:
+    explicit ScopedLatency(LatencyHistogram& histogram)
+        : histogram(histogram), start(std::chrono::steady_clock::now()), active(true)
+    {
+    }
+
+    ~ScopedLatency()
+    {
+        Stop();
+    }
+
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+    // Records now instead of at scope exit
+    void Stop()
+    {
+        if (active)
+        {
+            histogram.Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()));
+            active = false;
+        }
+    }
+
+private:
+    LatencyHistogram& histogram;
+    std::chrono::steady_clock::time_point start;
+    bool active;
+};
+
+#endif // METRICS_H
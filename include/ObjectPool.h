@@ -2,47 +2,278 @@
 #define OBJECTPOOL_H
 
 #include <vector>
-#include <iostream>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <new>
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
 #include <typeinfo>
+#include "Metrics.h"
+#include "Logger.h"
 
 template<typename T>
 class ObjectPool
 {
+private:
+    // A free slot links to the next free slot, an acquired slot holds a T
+    union Slot
+    {
+        Slot* next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
 public:
-    // Constructor to initialize the pool with a specific size
-    ObjectPool(size_t poolSize)
+    // Owns an acquired object and returns it to the pool when it goes out of scope
+    class Handle
     {
-        pool.reserve(poolSize);  // Reserve space to avoid resizing
+    public:
+        Handle() : pool(nullptr), object(nullptr) {}
+        Handle(ObjectPool* pool, T* object) : pool(pool), object(object) {}
+        Handle(Handle&& other) : pool(other.pool), object(other.Detach()) {}
+        ~Handle() { Reset(); }
+
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+
+        Handle& operator=(Handle&& other)
+        {
+            if (this != &other)
+            {
+                Reset();
+                pool = other.pool;
+                object = other.Detach();
+            }
+            return *this;
+        }
+
+        T* Get() const { return object; }
+        T* operator->() const { return object; }
+        T& operator*() const { return *object; }
+        explicit operator bool() const { return object != nullptr; }
 
-        // Create 'poolSize' objects initially
-        for (size_t i = 0; i < poolSize; ++i)
+        // Gives up ownership, the caller becomes responsible for releasing the object
+        T* Detach()
         {
-            pool.push_back(new T());
+            T* detached = object;
+            object = nullptr;
+            return detached;
         }
 
+        // Returns the object to the pool now
+        void Reset()
+        {
+            if (object)
+            {
+                pool->Release(object);
+                object = nullptr;
+            }
+        }
+
+    private:
+        ObjectPool* pool;
+        T* object;
+    };
+
+    // Constructor to initialize the pool with one slab of 'poolSize' slots
+    // A growable pool adds another slab of the same size whenever the free list runs dry
+    ObjectPool(size_t poolSize, bool growable = true)
+        : freeList(nullptr), slabSize(poolSize > 0 ? poolSize : 1), growable(growable), capacity(0), inUse(0),
+          hits(0), misses(0), failures(0), releases(0), peakInUse(0)
+    {
+        AddSlab();
+
         // unit test - Debug print to verify pool size
-        //std::cout << "Pool initialized with " << pool.size() << " objects" << std::endl;
+        LOG_DEBUG("Pool initialized with " << capacity << " objects");
     }
 
-    // Acquire an object from the pool
+    // Destroys objects that were never released, then frees the slabs
+    ~ObjectPool()
+    {
+        if (inUse == 0)
+        {
+            return;
+        }
+
+        std::vector<std::vector<bool>> isFree(slabs.size(), std::vector<bool>(slabSize, false));
+        for (Slot* slot = freeList; slot; slot = slot->next)
+        {
+            size_t slabIndex = FindSlab(slot);
+            isFree[slabIndex][slot - slabs[slabIndex].get()] = true;
+        }
+
+        for (size_t slabIndex = 0; slabIndex < slabs.size(); ++slabIndex)
+        {
+            for (size_t i = 0; i < slabSize; ++i)
+            {
+                if (!isFree[slabIndex][i])
+                {
+                    reinterpret_cast<T*>(&slabs[slabIndex][i].storage)->~T();
+                }
+            }
+        }
+    }
+
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    // Acquire an object from the pool, nullptr if the pool is exhausted and cannot grow
     T* Acquire()
     {
-        // Always create a new object for each chunk
-        std::cout << "Creating new pool object: " << typeid(T).name() << std::endl;
-        return new T();
+        if (freeList)
+        {
+            ++hits;
+        }
+        else if (growable && AddSlab())
+        {
+            ++misses;
+            LOG_DEBUG("Pool grown to " << capacity << " objects");
+        }
+        else
+        {
+            ++failures;
+            return nullptr;
+        }
+
+        Slot* slot = freeList;
+        freeList = slot->next;
+        if (++inUse > peakInUse)
+        {
+            peakInUse = inUse;
+        }
+        return new (&slot->storage) T();
+    }
+
+    // Acquire an object that is released automatically
+    Handle AcquireHandle()
+    {
+        return Handle(this, Acquire());
     }
 
     // Release object back to the pool
     void Release(T* obj)
     {
-        // Return the object back to the pool
-        pool.push_back(obj);
+        assert(Owns(obj) && "ObjectPool: Object does not belong to this pool.");
+        obj->~T();
+
+        Slot* slot = reinterpret_cast<Slot*>(obj);
+        slot->next = freeList;
+        freeList = slot;
+        --inUse;
+        ++releases;
         // unit test - seeing when object is released
-        //std::cout << "Releasing object back to pool: " << typeid(T).name() << std::endl;
+        LOG_DEBUG("Releasing object back to pool: " << typeid(T).name());
+    }
+
+    // Checks whether the object lives in one of this pool's slabs, a binary search over the slab addresses
+    bool Owns(const T* obj) const
+    {
+        return FindSlab(reinterpret_cast<const Slot*>(obj)) < slabs.size();
+    }
+
+    size_t GetCapacity() const { return capacity; }
+    size_t GetInUse() const { return inUse; }
+
+    // A hit is served from the free list, a miss had to add a slab, a failure returned nullptr
+    struct Stats
+    {
+        size_t hits;
+        size_t misses;
+        size_t failures;
+        size_t releases;
+        size_t inUse;
+        size_t peakInUse;
+        size_t capacity;
+        size_t slabCount;
+    };
+
+    Stats GetStats() const
+    {
+        return { hits, misses, failures, releases, inUse, peakInUse, capacity, slabs.size() };
+    }
+
+    void ResetStats()
+    {
+        hits = misses = failures = releases = 0;
+        peakInUse = inUse;
+    }
+
+    void WriteStatsJson(JsonWriter& json) const
+    {
+        size_t acquires = hits + misses + failures;
+        json.BeginObject();
+        json.Key("hits").Value(hits);
+        json.Key("misses").Value(misses);
+        json.Key("failures").Value(failures);
+        json.Key("hitRate").Value(acquires ? static_cast<double>(hits) / acquires : 0.0);
+        json.Key("releases").Value(releases);
+        json.Key("inUse").Value(inUse);
+        json.Key("peakInUse").Value(peakInUse);
+        json.Key("capacity").Value(capacity);
+        json.Key("slabCount").Value(slabs.size());
+        json.EndObject();
     }
 
 private:
-    std::vector<T*> pool;  // Vector to hold available objects in the pool
+    // Allocates a slab and threads all of its slots onto the free list
+    bool AddSlab()
+    {
+        std::unique_ptr<Slot[]> slab(new (std::nothrow) Slot[slabSize]);
+        if (!slab)
+        {
+            return false;
+        }
+
+        for (size_t i = slabSize; i > 0; --i)
+        {
+            slab[i - 1].next = freeList;
+            freeList = &slab[i - 1];
+        }
+
+        // Slab starts stay sorted by address so FindSlab can binary-search them
+        const Slot* first = slab.get();
+        slabStarts.insert(std::upper_bound(slabStarts.begin(), slabStarts.end(), first, StartsAfter), SlabStart(first, slabs.size()));
+        slabs.push_back(std::move(slab));
+        capacity += slabSize;
+        return true;
+    }
+
+    // Index of the slab holding the slot, slabs.size() if none does. O(log slabs) through slabStarts.
+    size_t FindSlab(const Slot* slot) const
+    {
+        // The last slab starting at or before the slot is the only one that can hold it
+        auto next = std::upper_bound(slabStarts.begin(), slabStarts.end(), slot, StartsAfter);
+        if (next == slabStarts.begin())
+        {
+            return slabs.size();
+        }
+
+        const SlabStart& start = *(next - 1);
+        return slot < start.first + slabSize ? start.second : slabs.size();
+    }
+
+    // First slot of a slab and its index in slabs
+    typedef std::pair<const Slot*, size_t> SlabStart;
+
+    static bool StartsAfter(const Slot* slot, const SlabStart& start)
+    {
+        return std::less<const Slot*>()(slot, start.first);
+    }
+
+    std::vector<std::unique_ptr<Slot[]>> slabs;  // Contiguous slot storage, one slab per growth step
+    std::vector<SlabStart> slabStarts;           // Every slab's first slot, sorted by address
+    Slot* freeList;                              // Intrusive list of free slots
+    size_t slabSize;
+    bool growable;
+    size_t capacity;
+    size_t inUse;
+    size_t hits;
+    size_t misses;
+    size_t failures;
+    size_t releases;
+    size_t peakInUse;
 };
 
 #endif // OBJECTPOOL_H
@@ -3,6 +3,9 @@
 
 #include <SDL.h>
 #include <SDL_image.h>
+#include "TgaImage.h"
+#include "DirtyRangeSet.h"
+#include <cstddef>
 #include <string>
 
 class SDLManager
@@ -14,6 +17,22 @@ public:
     // Initialize SDL and create the window and renderer
     bool Init(const std::string& windowTitle, int width, int height, const std::string& imagePath);
 
+    // Same, but the image is a TGA file already in memory. Uncompressed true-color pixels are
+    // uploaded to the texture in place, anything else is decoded from memory. Nothing touches the disk.
+    bool Init(const std::string& windowTitle, int width, int height, const void* imageData, size_t imageSize);
+
+    // Re-uploads only the texture rows covering the changed bytes of the image Init was given.
+    // False when the texture cannot be patched (decoded image, header or size changed), Init again then.
+    bool UpdateImage(const void* imageData, size_t imageSize, const DirtyRangeSet& changes);
+
+    // Keeps the window, renderer and texture alive while the menu has the console
+    void Hide();
+    void Show();
+    bool IsInitialized() const;
+
+    // Destroys the texture but keeps SDL, the window and the renderer for the next Init
+    void ReleaseImage();
+
     // Handle events such as window resizing
     void HandleEvents(bool& running);
 
@@ -26,13 +45,34 @@ public:
     // Render the current texture
     void Render();
 
-    // Clean up SDL resources
+    // Clean up SDL resources and shut SDL down
     void Cleanup();
 
+    // SDL and SDL_image setup shared by both Init overloads, done once until Cleanup
+    bool InitLibraries();
+
 private:
+
+    // Window sized to the image, and its renderer
+    bool CreateWindowAndRenderer(const std::string& windowTitle, int width, int height);
+
+    // Takes ownership of the surface
+    bool CreateTextureFromSurface(SDL_Surface* surface);
+
+    // Uploads uncompressed TGA pixels straight into a streaming texture
+    bool CreateTextureFromPixels(const TgaImage& image, const void* imageData);
+
+    // Uploads rowCount stored rows starting at firstRow
+    bool UpdateRows(const void* imageData, uint32_t firstRow, uint32_t rowCount);
+
     SDL_Window* window;
     SDL_Renderer* renderer;
     SDL_Texture* texture;
+    SDL_RendererFlip flip;  // TGA rows are usually stored bottom-up, the renderer flips them instead of copying
+    TgaImage image;         // Layout of the in-memory image behind the texture
+    bool rawTexture;        // The texture holds the image's stored rows as-is and can be patched
+    size_t imageSize;
+    bool librariesReady;    // SDL and SDL_image are initialized
 };
 
 #endif // SDLMANAGER_H
\ No newline at end of file
@@ -2,21 +2,82 @@
 #define STACKALLOCATOR_H
 
 #include <cstddef>
+#include <vector>
+
+class JsonWriter;
 
 class StackAllocator
 {
 public:
-    StackAllocator(size_t totalSize);
+    // Alignment used when none is given, suitable for any scalar type
+    static const size_t DefaultAlignment = alignof(std::max_align_t);
+
+    // Frees everything allocated after its creation when it goes out of scope
+    class ScopedMarker
+    {
+    public:
+        explicit ScopedMarker(StackAllocator& allocator);
+        ~ScopedMarker();
+
+        ScopedMarker(const ScopedMarker&) = delete;
+        ScopedMarker& operator=(const ScopedMarker&) = delete;
+
+        // Keeps the allocations made in this scope
+        void Dismiss();
+
+    private:
+        StackAllocator& _allocator;
+        size_t _marker;
+        bool _active;
+    };
+
+    // A growable allocator chains a new page when the current one is full instead of failing
+    StackAllocator(size_t totalSize, bool growable = false);
     ~StackAllocator();
 
-    void* Allocate(size_t size);
+    StackAllocator(const StackAllocator&) = delete;
+    StackAllocator& operator=(const StackAllocator&) = delete;
+
+    // Returns nullptr when the allocator is exhausted, alignment must be a power of two
+    void* Allocate(size_t size, size_t alignment = DefaultAlignment);
     void FreeToMarker(size_t marker);
     size_t GetMarker() const;
 
+    // Total bytes reserved across all pages
+    size_t GetCapacity() const;
+
+    // Usage counters, cheap enough to keep on in release builds
+    struct Stats
+    {
+        size_t allocations;        // Successful Allocate calls
+        size_t failedAllocations;  // Allocate calls that returned nullptr
+        size_t bytesInUse;         // Current marker
+        size_t highWaterMark;      // Largest marker seen since construction or ResetStats
+        size_t pageCount;
+        size_t capacity;
+    };
+
+    Stats GetStats() const;
+    void ResetStats();
+    void WriteStatsJson(JsonWriter& json) const;
+
 private:
-    void* _start;
-    size_t _offset;
-    size_t _totalSize;
+    struct Page
+    {
+        unsigned char* start;
+        size_t size;
+        size_t base;  // Marker value at the start of the page
+    };
+
+    bool AddPage(size_t minSize);
+
+    std::vector<Page> _pages;
+    size_t _offset;    // Offset into the last page
+    size_t _pageSize;  // Size of chained pages, unless an allocation needs more
+    bool _growable;
+    size_t _allocations;
+    size_t _failedAllocations;
+    size_t _highWaterMark;
 };
 
 #endif
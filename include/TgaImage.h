@@ -0,0 +1,38 @@
+#ifndef TGAIMAGE_H
+#define TGAIMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Layout of a TGA image held in memory, parsed from its 18 byte header without copying any pixels
+struct TgaImage
+{
+    enum class PixelFormat
+    {
+        Other,   // Color-mapped, run-length encoded or an unusual depth, needs a full decoder
+        Gray8,
+        Argb1555,
+        Bgr24,
+        Bgra32
+    };
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t bytesPerPixel = 0;
+    PixelFormat format = PixelFormat::Other;
+    size_t pixelOffset = 0;  // Offset of the first stored row from the start of the file
+    size_t pitch = 0;        // Bytes per row, rows are packed
+    bool bottomUp = true;    // The first stored row is the bottom row of the picture
+    bool rightToLeft = false;
+
+    // False if the header is truncated or describes pixels past the end of the data
+    static bool Parse(const void* data, size_t size, TgaImage& image);
+
+    // Uncompressed true-color or grayscale pixels that can be used in place
+    bool IsRaw() const { return format != PixelFormat::Other; }
+
+    // Stored rows (0 = first in the file) touched by the file bytes [begin, end), false if no pixel row is
+    bool GetStoredRows(size_t begin, size_t end, uint32_t& firstRow, uint32_t& rowCount) const;
+};
+
+#endif // TGAIMAGE_H
@@ -0,0 +1,79 @@
+#ifndef TLSFALLOCATOR_H
+#define TLSFALLOCATOR_H
+
+#include "ChunkAllocator.h"
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Two-level segregated fit allocator. Free blocks sit in size class lists found through two bitmaps, so Allocate
+// and Free are O(1), and a freed block merges with free neighbours right away, so memory does not creep up
+// over long runs of allocations and frees. Memory comes in pools of poolSize bytes that are kept until destruction,
+// a growable allocator adds a pool when no free block fits.
+class TlsfAllocator : public ChunkAllocator
+{
+public:
+    TlsfAllocator(size_t poolSize, bool growable = false);
+    ~TlsfAllocator();
+
+    TlsfAllocator(const TlsfAllocator&) = delete;
+    TlsfAllocator& operator=(const TlsfAllocator&) = delete;
+
+    void* Allocate(size_t size, size_t alignment = DefaultAlignment) override;
+    void Free(void* block) override;
+
+    Stats GetStats() const override;
+    void WriteStatsJson(JsonWriter& json) const override;
+
+    // Largest block Allocate can return without adding a pool
+    size_t GetLargestFreeBlock() const;
+    size_t GetPoolCount() const;
+
+private:
+    struct Block;
+
+    // Blocks are 16-byte aligned and sized, the second level splits every power of two into 32 lists
+    static const int AlignmentLog2 = 4;
+    static const int SecondLevelLog2 = 5;
+    static const int SecondLevelCount = 1 << SecondLevelLog2;
+    static const int FirstLevelShift = SecondLevelLog2 + AlignmentLog2;
+    static const int FirstLevelCount = 32;  // Blocks up to 2^40 bytes
+
+    bool AddPool(size_t minSize);
+
+    // Size class of a free block of this size, and the first class whose blocks all hold this size
+    static bool MapInsert(size_t size, int& firstLevel, int& secondLevel);
+    static bool MapSearch(size_t size, int& firstLevel, int& secondLevel);
+
+    // Takes a free block of at least size bytes out of its list, nullptr if there is none
+    Block* FindFree(size_t size);
+    void InsertFree(Block* block);
+    void RemoveFree(Block* block);
+
+    // Frees the first gap bytes of a block taken from the list, returns the block that starts after them
+    Block* SplitFront(Block* block, size_t gap);
+
+    // Frees everything past the first size bytes of a block taken from the list, when that is worth a block
+    void SplitBack(Block* block, size_t size);
+
+    // Payload bytes of a block without the free flag
+    static size_t SizeOf(const Block* block);
+
+    size_t GetLargestFreeBlockLocked() const;
+
+    mutable std::mutex mutex;
+    uint32_t firstLevelBitmap;
+    uint32_t secondLevelBitmaps[FirstLevelCount];
+    Block* freeLists[FirstLevelCount][SecondLevelCount];
+    std::vector<void*> pools;
+    size_t poolSize;
+    bool growable;
+    size_t capacity;
+    size_t allocations;
+    size_t frees;
+    size_t failedAllocations;
+    size_t bytesInUse;
+    size_t highWaterMark;
+};
+
+#endif // TLSFALLOCATOR_H
@@ -0,0 +1,56 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads for CPU work such as checksums and compression, started once and reused by every call.
+// The calling thread always takes part, so a busy or nested pool never leaves a loop waiting.
+class WorkerPool
+{
+public:
+    // workerCount 0 starts one thread less than the hardware has, the caller makes up the last one
+    explicit WorkerPool(unsigned int workerCount = 0);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Shared instance, its threads live for the whole process
+    static WorkerPool& Default();
+
+    // Runs task(i) for every i below count on up to threadCount threads, the calling thread included
+    // (threadCount 0 uses every worker), and returns once all of them are done
+    void ParallelFor(size_t count, unsigned int threadCount, const std::function<void(size_t)>& task);
+
+    unsigned int GetWorkerCount() const;
+
+private:
+    // One ParallelFor call, shared by the caller and the workers that joined it
+    struct Loop
+    {
+        const std::function<void(size_t)>* task;
+        size_t count;
+        std::atomic<size_t> next;  // Next index to run
+        unsigned int running;      // Workers inside the loop, changed under mutex
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+
+    static void RunLoop(Loop& loop);
+    void WorkerLoop();
+
+    std::vector<std::thread> workers;
+    std::deque<Loop*> tickets;  // One entry per worker a loop asked for
+    std::mutex ticketMutex;
+    std::condition_variable ticketAvailable;
+    bool stopping;
+};
+
+#endif // WORKERPOOL_H
@@ -1,19 +1,25 @@
 #include "Asset.h"
 #include "Level.h"
-#include "SDLManager.h"
+#include "ChunkStore.h"
+#include "TlsfAllocator.h"
+#include "ImageViewer.h"
 #include "StackAllocator.h"
 #include "ObjectPool.h"
+#include "Metrics.h"
+#include "Logger.h"
+#include "WorkerPool.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <vector>
-#include <stack>
-
-std::stack<std::string> undoStack;
-std::stack<std::string> redoStack;
+#include <string>
 
 void DisplayMenu(Level& level);
-void HandleMenuAction(char choice, Level& level, bool& running, bool& viewImage, SDLManager& sdlManager, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool, ObjectPool<Asset>& assetPool, const std::vector<std::string>& chunkFiles);
-void UndoAction(std::stack<std::string>& undoStack, std::stack<std::string>& redoStack, Level& level, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool, ObjectPool<Asset>& assetPool);
-void RedoAction(std::stack<std::string>& undoStack, std::stack<std::string>& redoStack, Level& level, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool, ObjectPool<Asset>& assetPool);
+int RunBatch(int argc, char* argv[], int firstManifest);
+void PublishImage(Level& level, ImageViewer& viewer);
+bool FillImageBuffer(Level& level, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool);
+void HandleMenuAction(char choice, Level& level, bool& running, ImageViewer& viewer, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool, ObjectPool<Asset>& assetPool, const std::vector<std::string>& chunkFiles);
 
 
 int main(int argc, char* argv[])
@@ -23,17 +29,80 @@ int main(int argc, char* argv[])
         "assets/chunk3.bin", "assets/chunk4.bin", "assets/chunk5.bin", "assets/chunk6.bin"
     };
 
+    // --verify checks a level file's checksums and exits
+    if (argc > 1 && std::string(argv[1]) == "--verify")
+    {
+        return Level::VerifyLevel(argc > 2 ? argv[2] : "level.bin") ? 0 : -1;
+    }
+
+    // --batch assembles, saves and verifies every listed manifest without the menu, then exits
+    if (argc > 1 && std::string(argv[1]) == "--batch")
+    {
+        return RunBatch(argc, argv, 2);
+    }
+
+    // --stream assembles the image without holding it in memory, then exits
+    int argIndex = 1;
+    bool streamOnly = argc > argIndex && std::string(argv[argIndex]) == "--stream";
+    if (streamOnly)
+    {
+        ++argIndex;
+    }
+
+    // --chunk-budget caps the bytes of chunk payloads kept in memory, least recently used chunks are read again when needed
+    size_t chunkBudget = 0;
+    if (argc > argIndex + 1 && std::string(argv[argIndex]) == "--chunk-budget")
+    {
+        chunkBudget = static_cast<size_t>(std::strtoull(argv[argIndex + 1], nullptr, 10));
+        argIndex += 2;
+    }
+
+    // --chunk-arena keeps chunk payloads in TLSF pools of that many bytes, so removed chunks give their memory back for reuse
+    if (argc > argIndex + 1 && std::string(argv[argIndex]) == "--chunk-arena")
+    {
+        size_t arenaSize = static_cast<size_t>(std::strtoull(argv[argIndex + 1], nullptr, 10));
+        ChunkStore::Instance().SetAllocator(std::make_shared<TlsfAllocator>(arenaSize, true));
+        argIndex += 2;
+    }
+
+    // --prefetch reads that many chunk files ahead while chunks are added in order
+    size_t prefetchWindow = 0;
+    if (argc > argIndex + 1 && std::string(argv[argIndex]) == "--prefetch")
+    {
+        prefetchWindow = static_cast<size_t>(std::strtoull(argv[argIndex + 1], nullptr, 10));
+        argIndex += 2;
+    }
+
+    // A chunk manifest given on the command line replaces the default chunk files
+    if (argc > argIndex && !Level::ReadChunkManifest(argv[argIndex], chunkFiles))
+    {
+        return -1;
+    }
+
     // Create output image file path & calculate the total chunk size
     const std::string outputImagePath = "NewImage.tga";
-    size_t totalChunkSize = Level::CalculateTotalChunkSize(chunkFiles);
-    Level level(totalChunkSize);
+    ObjectPool<FileChunk> fileChunkPool(chunkFiles.size());
+    if (streamOnly)
+    {
+        Level streamLevel;
+        return streamLevel.AssembleChunksStreaming(chunkFiles, fileChunkPool, outputImagePath) ? 0 : -1;
+    }
+
+    Level level;
+    level.SetChunkManifest(chunkFiles, fileChunkPool);
+    size_t totalChunkSize = level.GetRequiredImageSize();
+    level.SetResidencyBudget(chunkBudget);
+    level.SetPrefetchWindow(prefetchWindow);
 
     int currentChunkIndex = 0;  // Initialize it to 0 or based on your logic
 
+    // Chunks are memory-mapped when added, so only level loads and reads of not yet loaded chunks draw from the allocator
+    level.SetIngestMode(Level::ChunkIngestMode::Mapped);
+
     // Create a stack allocator, object pool, level instance and image buffer
-    StackAllocator allocator(totalChunkSize * 2);
-    ObjectPool<FileChunk> fileChunkPool(7);
-    ObjectPool<Asset> assetPool(7);
+    // The allocator chains more pages when a loaded level needs more than the initial size
+    StackAllocator allocator(totalChunkSize, true);
+    ObjectPool<Asset> assetPool(chunkFiles.size());
 
     // Initialize the Level
    // Level level;
@@ -53,75 +122,230 @@ int main(int argc, char* argv[])
     //TestIsChunkLoaded(level);
     //TestGetChunkStartAndSize(level);
 
-    // **Add chunks to the level** using the loop
-    for (int i = 0; i < 7; ++i)
-    {   // unit test - chunk execution in UI
-        //std::cout << "Processing chunk " << i << std::endl;
-        level.AddChunk(i, chunkFiles[i], allocator, fileChunkPool, assetPool, undoStack);  // Pass assetPool as the fifth argument
-    }
-
-    // After initial chunk loading, disable initial run behavior in pools
-    //fileChunkPool.DisableInitialRun();
-    //assetPool.DisableInitialRun();
-
-
-    if (!level.AssembleChunks(chunkFiles, allocator, fileChunkPool, "NewImage.tga", assetPool))
+    // Create the image buffer and read every chunk into it in parallel
+    level.CreateImageBuffer(totalChunkSize);
+    if (!level.AssembleChunksParallel(chunkFiles, fileChunkPool, outputImagePath))
     {
-        std::cerr << "Failed to assemble chunks." << std::endl;
+        LOG_ERROR("Failed to assemble chunks.");
         return -1;
     }
 
-    // Initialize SDL Manager
-    SDLManager sdlManager;
+    // The viewer runs on its own thread once the image is first viewed, the menu keeps the console
+    ImageViewer viewer;
 
     bool running = true;
-    bool viewImage = false;
     while (running)
     {
-        if (!viewImage)  // Show menu when not viewing the image
+        DisplayMenu(level);
+
+        char choice;
+        if (!(std::cin >> choice))
         {
-            DisplayMenu(level);
+            break;
+        }
 
-            char choice;
-            std::cin >> choice;
+        HandleMenuAction(choice, level, running, viewer, allocator, fileChunkPool, assetPool, chunkFiles);
 
-            HandleMenuAction(choice, level, running, viewImage, sdlManager, allocator, fileChunkPool, assetPool, chunkFiles);
+        // An open viewer follows every change to the image buffer
+        if (running && viewer.IsVisible() && level.GetImageBuffer())
+        {
+            PublishImage(level, viewer);
         }
-        else
+    }
+    viewer.Stop();
+    LOG_INFO("Exiting program...");
+    return 0;
+}
+
+// Drops the extension of the file name, if it has one
+static std::string StripExtension(const std::string& path)
+{
+    size_t nameStart = path.find_last_of("/\\");
+    nameStart = nameStart == std::string::npos ? 0 : nameStart + 1;
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || dot <= nameStart)
+    {
+        return path;
+    }
+    return path.substr(0, dot);
+}
+
+// Assembles each manifest into <manifest>.tga, saves it as the level file <manifest>.level and verifies it.
+// One Level, FileChunk pool and the shared AsyncIO and WorkerPool threads serve every manifest. Prints a JSON summary to std::cout.
+int RunBatch(int argc, char* argv[], int firstManifest)
+{
+    if (firstManifest >= argc)
+    {
+        std::cerr << "Usage: " << argv[0] << " --batch [--no-compress] manifest..." << std::endl;
+        return -1;
+    }
+
+    bool compress = true;
+    if (std::string(argv[firstManifest]) == "--no-compress")
+    {
+        compress = false;
+        ++firstManifest;
+    }
+
+    // Only failures are logged, std::cout carries the summary
+    Logger::Instance().SetLevel(LogLevel::Warning);
+
+    // Started once here, saving, verifying and loading levels all run on these threads
+    WorkerPool& workerPool = WorkerPool::Default();
+
+    auto batchStart = std::chrono::steady_clock::now();
+    ObjectPool<FileChunk> fileChunkPool(256);
+    Level level;
+    int failedCount = 0;
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Key("levels").BeginArray();
+    for (int i = firstManifest; i < argc; ++i)
+    {
+        auto levelStart = std::chrono::steady_clock::now();
+        const std::string manifestPath = argv[i];
+        const std::string basePath = StripExtension(manifestPath);
+        const std::string imagePath = basePath + ".tga";
+        const std::string levelPath = basePath + ".level";
+
+        // Each step runs only if the previous one succeeded, the first failure is reported
+        std::vector<std::string> chunkFiles;
+        std::string error;
+        if (!Level::ReadChunkManifest(manifestPath, chunkFiles))
         {
-            sdlManager.HandleEvents(viewImage);
+            error = "manifest";
+        }
 
-            if (viewImage)
+        // The new manifest returns the previous level's chunks to the pool, its image buffer is replaced
+        level.SetChunkManifest(chunkFiles, fileChunkPool);
+        if (level.GetImageBuffer())
+        {
+            level.DeleteImageBuffer();
+        }
+        if (error.empty())
+        {
+            level.CreateImageBuffer(level.GetRequiredImageSize());
+            if (!level.GetImageBuffer() && level.GetRequiredImageSize() > 0)
+            {
+                error = "image buffer";
+            }
+            else if (!level.AssembleChunksParallel(chunkFiles, fileChunkPool, imagePath))
+            {
+                error = "assemble";
+            }
+            else if (!level.SaveLevel(levelPath, compress))
             {
-                sdlManager.Render();
+                error = "save";
             }
-            else
+            else if (!Level::VerifyLevel(levelPath))
             {
-                sdlManager.Cleanup();
-                std::cout << "Returning to the menu...\n";
-                std::cin.clear();
-                std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');  // Ignore leftover input
+                error = "verify";
             }
         }
+
+        if (!error.empty())
+        {
+            ++failedCount;
+        }
+
+        json.BeginObject();
+        json.Key("manifest").Value(manifestPath);
+        json.Key("image").Value(imagePath);
+        json.Key("level").Value(levelPath);
+        json.Key("chunks").Value(chunkFiles.size());
+        json.Key("imageBytes").Value(level.GetRequiredImageSize());
+        json.Key("succeeded").Value(error.empty());
+        if (!error.empty())
+        {
+            json.Key("failedStep").Value(error);
+        }
+        json.Key("seconds").Value(std::chrono::duration<double>(std::chrono::steady_clock::now() - levelStart).count());
+        json.EndObject();
     }
-    sdlManager.Cleanup();
-    std::cout << "Exiting program...\n";
-    return 0;
+    level.SetChunkManifest(std::vector<std::string>(), fileChunkPool);
+    json.EndArray();
+
+    json.Key("succeeded").Value(argc - firstManifest - failedCount);
+    json.Key("failed").Value(failedCount);
+    json.Key("seconds").Value(std::chrono::duration<double>(std::chrono::steady_clock::now() - batchStart).count());
+    json.Key("metrics").BeginObject();
+    json.Key("level");
+    level.WriteStatsJson(json);
+    json.Key("fileChunkPool");
+    fileChunkPool.WriteStatsJson(json);
+    json.Key("workerThreads").Value(workerPool.GetWorkerCount());
+    json.EndObject();
+    json.EndObject();
+
+    Logger::Instance().Flush();
+    std::cout << json.ToString() << std::endl;
+    return failedCount == 0 ? 0 : -1;
 }
 
 void DisplayMenu(Level& level)
 {
+    // Queued log lines go out before the prompt
+    Logger::Instance().Flush();
     std::cout << "\n";
     std::cout << "[Q]uit   [S]ave   [L]oad level   [Z]Undo   [Y]Redo\n";
     std::cout << "[C]reate image buffer   [D]elete image buffer\n";
-    std::cout << "[A]dd Chunk  [R]emove chunk   [V]iew Image(X to exit image)\n";
+    std::cout << "[A]dd Chunk  [R]emove chunk   [V]iew Image (X closes the window)\n";
+    std::cout << "[M]etrics\n";
     std::cout << "Index (" << level.GetCurrentChunkIndex() << ")   ";
-    std::cout << "   Undo count (" << undoStack.size() << ")   ";
-    std::cout << "   Redo count (" << redoStack.size() << ")\n";
+    std::cout << "   Undo count (" << level.GetUndoDepth() << ")   ";
+    std::cout << "   Redo count (" << level.GetRedoDepth() << ")\n";
     std::cout << "Input: ";
 }
 
-void HandleMenuAction(char choice, Level& level, bool& running, bool& viewImage, SDLManager& sdlManager, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool, ObjectPool<Asset>& assetPool, const std::vector<std::string>& chunkFiles)
+// Hands the viewer what changed in the image buffer since the last call, or the saved image once there is no buffer
+void PublishImage(Level& level, ImageViewer& viewer)
+{
+    if (!level.GetImageBuffer())
+    {
+        viewer.ShowFile("NewImage.tga");
+        return;
+    }
+
+    DirtyRangeSet changes;
+    level.TakeImageChanges(changes);
+    viewer.UpdateImage(level.GetImageBuffer(), level.GetImageSize(), changes);
+}
+
+// Creates an image buffer for the level's chunk table and copies every chunk of the level into its slot
+bool FillImageBuffer(Level& level, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool)
+{
+    level.CreateImageBuffer(level.GetRequiredImageSize());
+    if (!level.GetImageBuffer() && level.GetRequiredImageSize() > 0)
+    {
+        return false;
+    }
+
+    // One batch reads what fits the residency budget, LoadChunk faults in the rest one at a time
+    if (!level.LoadAllChunks(allocator, fileChunkPool))
+    {
+        return false;
+    }
+    for (size_t i = 0; i < level.GetChunkCount(); ++i)
+    {
+        int chunkIndex = static_cast<int>(i);
+        if (!level.IsChunkLoaded(chunkIndex))
+        {
+            continue;
+        }
+
+        FileChunk* chunk = level.LoadChunk(chunkIndex, allocator, fileChunkPool);
+        void* chunkStart = level.GetChunkStart(chunkIndex);
+        if (!chunk || !chunkStart)
+        {
+            return false;
+        }
+        memcpy(chunkStart, chunk->GetData(), chunk->GetSize());
+    }
+    return true;
+}
+
+void HandleMenuAction(char choice, Level& level, bool& running, ImageViewer& viewer, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool, ObjectPool<Asset>& assetPool, const std::vector<std::string>& chunkFiles)
 {
     switch (toupper(choice))
     {
@@ -129,160 +353,114 @@ void HandleMenuAction(char choice, Level& level, bool& running, bool& viewImage,
         running = false;
         break;
     case 'S':
-        if (level.SaveLevel("level.bin"))
+        if (level.SaveLevel("level.bin", true))
         {
-            std::cout << "Level saved to level.bin\n";
+            LOG_INFO("Level saved to level.bin");
         }
         else
         {
-            std::cerr << "Failed to save the level!\n";
+            LOG_ERROR("Failed to save the level!");
         }
         break;
     case 'L':
     {
-        std::cout << "Loading level...\n";
-        size_t totalChunkSize = Level::CalculateTotalChunkSize(chunkFiles);  // Scoped inside the case
-        if (level.LoadLevel("level.bin", allocator, fileChunkPool, assetPool))
+        LOG_INFO("Loading level...");
+
+        // The old image buffer goes first, deleting it afterwards would mark the loaded chunks as removed
+        if (level.GetImageBuffer())
+        {
+            level.DeleteImageBuffer();
+        }
+        if (level.LoadLevel("level.bin", allocator, fileChunkPool, assetPool) && FillImageBuffer(level, allocator, fileChunkPool))
         {
-            std::cout << "Level loaded from level.bin\n";
+            LOG_INFO("Level loaded from level.bin");
         }
         else
         {
-            std::cerr << "Failed to load the level!\n";
+            LOG_ERROR("Failed to load the level!");
         }
         break;
     }
     case 'Z':
-        UndoAction(undoStack, redoStack, level, allocator, fileChunkPool, assetPool);
+        level.Undo(allocator, fileChunkPool);
         break;
     case 'Y':
-        RedoAction(undoStack, redoStack, level, allocator, fileChunkPool, assetPool);
+        level.Redo(allocator, fileChunkPool);
         break;
     case 'C':
     {
-        std::cout << "Creating image buffer...\n";
-        size_t totalChunkSize = Level::CalculateTotalChunkSize(chunkFiles);  // Properly scoped
-        level.CreateImageBuffer(totalChunkSize);
+        LOG_INFO("Creating image buffer...");
+        level.CreateImageBuffer(level.GetRequiredImageSize());
         break;
     }
     case 'D':
-        std::cout << "Deleting image buffer...\n";
+        LOG_INFO("Deleting image buffer...");
         level.DeleteImageBuffer();
         break;
     case 'A':
     {
         int chunkIndex;
-        std::cout << "Enter chunk index to add (0-6): ";
+        std::cout << "Enter chunk index to add (0-" << chunkFiles.size() - 1 << "): ";
         std::cin >> chunkIndex;
-        if (chunkIndex >= 0 && chunkIndex < 7)
+        if (chunkIndex >= 0 && chunkIndex < static_cast<int>(chunkFiles.size()))
         {
-            level.AddChunk(chunkIndex, chunkFiles[chunkIndex], allocator, fileChunkPool, assetPool, undoStack);
-            std::cout << "Adding chunk...\n";
+            level.AddChunk(chunkIndex, chunkFiles[chunkIndex], allocator, fileChunkPool, assetPool);
+            LOG_INFO("Adding chunk...");
         }
         else
         {
-            std::cerr << "Invalid chunk index." << std::endl;
+            LOG_ERROR("Invalid chunk index.");
         }
         break;
     }
     case 'R':  // Remove chunk
     {
         int chunkIndex;
-        std::cout << "Enter chunk index to remove (0-6): ";
+        std::cout << "Enter chunk index to remove (0-" << chunkFiles.size() - 1 << "): ";
         std::cin >> chunkIndex;
-        if (chunkIndex >= 0 && chunkIndex < 7)
+        if (chunkIndex >= 0 && chunkIndex < static_cast<int>(chunkFiles.size()))
         {
-            level.RemoveChunk(chunkIndex);
+            level.RemoveChunk(chunkIndex, allocator, fileChunkPool);
         }
         else
         {
-            std::cerr << "Invalid chunk index. Enter number within range!" << std::endl;
+            LOG_ERROR("Invalid chunk index. Enter number within range!");
         }
         break;
     }
     case 'V':  // View image
     {
-        viewImage = true;
-        if (!sdlManager.Init("SDLFileChunks", 800, 600, "NewImage.tga"))
+        // SDL is started once and kept, later views only send what changed
+        if (!viewer.IsRunning() && !viewer.Start("SDLFileChunks"))
         {
-            std::cerr << "Failed to initialize SDL Manager" << std::endl;
-            running = false;
+            LOG_ERROR("Failed to start the image viewer");
+            break;
         }
+        PublishImage(level, viewer);
+        viewer.Show();
         break;
     }
-    default:
-        std::cerr << "Unknown option selected!" << std::endl;
+    case 'M':  // Dump runtime metrics as JSON
+    {
+        JsonWriter json;
+        json.BeginObject();
+        json.Key("level");
+        level.WriteStatsJson(json);
+        json.Key("allocator");
+        allocator.WriteStatsJson(json);
+        json.Key("fileChunkPool");
+        fileChunkPool.WriteStatsJson(json);
+        json.Key("assetPool");
+        assetPool.WriteStatsJson(json);
+        json.EndObject();
+
+        // Printed directly, log lines are capped at Logger::MaxMessageSize
+        Logger::Instance().Flush();
+        std::cout << json.ToString() << std::endl;
         break;
     }
-}
-
-void UndoAction(std::stack<std::string>& undoStack, std::stack<std::string>& redoStack, Level& level, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool, ObjectPool<Asset>& assetPool)
-{
-    if (undoStack.empty()) {
-        std::cerr << "No actions to undo." << std::endl;
-        return;
-    }
-
-    std::string lastAction = undoStack.top();
-    undoStack.pop();
-
-    // Check if the last action was adding or removing a chunk
-    if (lastAction.find("AddChunk") != std::string::npos) {
-        int chunkIndex = std::stoi(lastAction.substr(lastAction.find(" ") + 1));
-
-        // Undo the add by removing the chunk
-        if (level.IsChunkLoaded(chunkIndex)) {
-            level.RemoveChunk(chunkIndex);
-            std::cout << "Undoing AddChunk action for chunk: " << chunkIndex << std::endl;
-        }
-    }
-    else if (lastAction.find("RemoveChunk") != std::string::npos) {
-        int chunkIndex = std::stoi(lastAction.substr(lastAction.find(" ") + 1));
-
-        // Undo the removal by adding the chunk back
-        std::cout << "Undoing RemoveChunk action for chunk: " << chunkIndex << std::endl;
-
-        // Fetch the chunk file
-        std::string chunkFile = level.GetChunkFile(chunkIndex);
-
-        // Add the chunk back
-        level.AddChunk(chunkIndex, chunkFile, allocator, fileChunkPool, assetPool, undoStack);
-
-        std::cout << "Redoing AddChunk action for chunk: " << chunkIndex << std::endl;
-    }
-
-    redoStack.push(lastAction); // Add the undone action to the redo stack
-}
-
-void RedoAction(std::stack<std::string>& undoStack, std::stack<std::string>& redoStack, Level& level, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool, ObjectPool<Asset>& assetPool)
-{
-    if (redoStack.empty()) {
-        std::cerr << "No actions to redo." << std::endl;
-        return;
-    }
-
-    std::string lastRedo = redoStack.top();
-    redoStack.pop();
-
-    // Check if the last undone action was adding or removing a chunk
-    if (lastRedo.find("AddChunk") != std::string::npos) {
-        int chunkIndex = std::stoi(lastRedo.substr(lastRedo.find(" ") + 1));
-
-        // Fetch the chunk file for the chunk being re-added
-        std::string chunkFile = level.GetChunkFile(chunkIndex);
-
-        // Redo the add chunk action
-        level.AddChunk(chunkIndex, chunkFile, allocator, fileChunkPool, assetPool, undoStack);
-        std::cout << "Redoing AddChunk action for chunk: " << chunkIndex << std::endl;
-    }
-    else if (lastRedo.find("RemoveChunk") != std::string::npos) {
-        int chunkIndex = std::stoi(lastRedo.substr(lastRedo.find(" ") + 1));
-
-        // Redo the remove chunk action
-        level.RemoveChunk(chunkIndex);
-        std::cout << "Redoing RemoveChunk action for chunk: " << chunkIndex << std::endl;
+    default:
+        LOG_ERROR("Unknown option selected!");
+        break;
     }
-
-    // Push the redone action back onto the undo stack
-    undoStack.push(lastRedo);
 }
@@ -0,0 +1,535 @@
+#include "AsyncIO.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#if defined(__linux__) && !defined(LEVEL_NO_IO_URING)
+#define LEVEL_HAS_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+IORequest IORequest::Read(const std::string& path, void* buffer, size_t size, uint64_t offset)
+{
+    return IORequest{ Type::Read, path, buffer, size, offset, -1 };
+}
+
+IORequest IORequest::Write(const std::string& path, const void* buffer, size_t size, uint64_t offset)
+{
+    return IORequest{ Type::Write, path, const_cast<void*>(buffer), size, offset, -1 };
+}
+
+IORequest IORequest::Stat(const std::string& path)
+{
+    return IORequest{ Type::Stat, path, nullptr, 0, 0, -1 };
+}
+
+bool IORequest::Succeeded() const
+{
+    return type == Type::Stat ? result >= 0 : result == static_cast<int64_t>(size);
+}
+
+#ifdef _WIN32
+void AsyncIO::ExecuteSync(IORequest& request)
+{
+    request.result = -1;
+    if (request.type == IORequest::Type::Stat)
+    {
+        WIN32_FILE_ATTRIBUTE_DATA attributes;
+        if (GetFileAttributesExA(request.path.c_str(), GetFileExInfoStandard, &attributes))
+        {
+            request.result = (static_cast<int64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+            request.modifiedTime = ((static_cast<int64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime) * 100;
+        }
+        return;
+    }
+
+    bool isRead = request.type == IORequest::Type::Read;
+    HANDLE file = CreateFileA(request.path.c_str(), isRead ? GENERIC_READ : GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+        nullptr, isRead ? OPEN_EXISTING : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    // Positional transfers in pieces a DWORD can describe
+    size_t done = 0;
+    while (done < request.size)
+    {
+        uint64_t position = request.offset + done;
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(position);
+        overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+
+        DWORD length = static_cast<DWORD>(std::min<size_t>(request.size - done, 1u << 30));
+        DWORD transferred = 0;
+        char* data = static_cast<char*>(request.buffer) + done;
+        BOOL ok = isRead ? ReadFile(file, data, length, &transferred, &overlapped) : WriteFile(file, data, length, &transferred, &overlapped);
+        if (!ok || transferred == 0)
+        {
+            break;
+        }
+        done += transferred;
+    }
+
+    CloseHandle(file);
+    request.result = static_cast<int64_t>(done);
+}
+#else
+void AsyncIO::ExecuteSync(IORequest& request)
+{
+    request.result = -1;
+    if (request.type == IORequest::Type::Stat)
+    {
+        struct stat fileStat;
+        if (stat(request.path.c_str(), &fileStat) == 0)
+        {
+            request.result = static_cast<int64_t>(fileStat.st_size);
+#ifdef __APPLE__
+            request.modifiedTime = static_cast<int64_t>(fileStat.st_mtimespec.tv_sec) * 1000000000 + fileStat.st_mtimespec.tv_nsec;
+#else
+            request.modifiedTime = static_cast<int64_t>(fileStat.st_mtim.tv_sec) * 1000000000 + fileStat.st_mtim.tv_nsec;
+#endif
+        }
+        return;
+    }
+
+    bool isRead = request.type == IORequest::Type::Read;
+    int fd = isRead ? open(request.path.c_str(), O_RDONLY | O_CLOEXEC) : open(request.path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    size_t done = 0;
+    while (done < request.size)
+    {
+        char* data = static_cast<char*>(request.buffer) + done;
+        off_t position = static_cast<off_t>(request.offset + done);
+        ssize_t transferred = isRead ? pread(fd, data, request.size - done, position) : pwrite(fd, data, request.size - done, position);
+        if (transferred < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (transferred <= 0)
+        {
+            break;
+        }
+        done += static_cast<size_t>(transferred);
+    }
+
+    close(fd);
+    request.result = static_cast<int64_t>(done);
+}
+#endif
+
+#ifdef LEVEL_HAS_IO_URING
+// Minimal io_uring submission/completion rings driven through the raw system calls
+struct AsyncIO::IoUring
+{
+    int fd = -1;
+    unsigned entries = 0;
+
+    void* sqRing = nullptr;
+    size_t sqRingSize = 0;
+    void* cqRing = nullptr;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    ~IoUring()
+    {
+        if (sqes)
+        {
+            munmap(sqes, sqesSize);
+        }
+        if (cqRing && cqRing != sqRing)
+        {
+            munmap(cqRing, cqRingSize);
+        }
+        if (sqRing)
+        {
+            munmap(sqRing, sqRingSize);
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+
+    bool Init(unsigned requestedEntries)
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, requestedEntries, &params));
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        entries = params.sq_entries;
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMap)
+        {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED)
+        {
+            sqRing = nullptr;
+            return false;
+        }
+
+        cqRing = singleMap ? sqRing : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED)
+        {
+            cqRing = nullptr;
+            return false;
+        }
+
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqeMemory = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqeMemory == MAP_FAILED)
+        {
+            return false;
+        }
+        sqes = static_cast<io_uring_sqe*>(sqeMemory);
+
+        char* sq = static_cast<char*>(sqRing);
+        char* cq = static_cast<char*>(cqRing);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    // Runs count operations, at most one ring's worth in flight, and stores each completion result.
+    // Operations the ring could not take keep -EIO, the caller redoes them on the thread pool.
+    template<typename Prepare>
+    void Run(size_t count, Prepare prepare, std::vector<int>& results)
+    {
+        results.assign(count, -EIO);
+        size_t prepared = 0;
+        size_t submitted = 0;
+        size_t completed = 0;
+        bool submitFailed = false;
+        while (completed < count)
+        {
+            unsigned tail = *sqTail;
+            while (!submitFailed && prepared < count && prepared - completed < entries)
+            {
+                unsigned index = tail & *sqMask;
+                io_uring_sqe& sqe = sqes[index];
+                memset(&sqe, 0, sizeof(sqe));
+                prepare(sqe, prepared);
+                sqe.user_data = prepared;
+                sqArray[index] = index;
+                ++tail;
+                ++prepared;
+            }
+            __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+            // The kernel may take fewer entries than asked, the rest stay in the ring and are submitted again
+            while (submitted < prepared)
+            {
+                int entered = static_cast<int>(syscall(__NR_io_uring_enter, fd, static_cast<unsigned>(prepared - submitted), 0, 0, nullptr, 0));
+                if (entered > 0)
+                {
+                    submitted += static_cast<size_t>(entered);
+                }
+                else if (entered == 0 || errno != EINTR)
+                {
+                    // Entries the kernel did not take are withdrawn, nothing more goes through the ring
+                    tail -= static_cast<unsigned>(prepared - submitted);
+                    __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+                    prepared = submitted;
+                    submitFailed = true;
+                }
+            }
+
+            // Nothing in flight is only left once the ring failed, the remaining operations keep -EIO
+            if (completed == submitted)
+            {
+                return;
+            }
+
+            // Wait for at least one completion unless some are already there
+            if (*cqHead == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+            {
+                syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            }
+
+            unsigned head = *cqHead;
+            unsigned ready = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            while (head != ready)
+            {
+                const io_uring_cqe& cqe = cqes[head & *cqMask];
+                results[static_cast<size_t>(cqe.user_data)] = cqe.res;
+                ++head;
+                ++completed;
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        }
+    }
+
+    // Runs the batch one ring's worth of requests at a time, so no more files than that are open at once
+    void Execute(std::vector<IORequest>& batch)
+    {
+        for (size_t begin = 0; begin < batch.size(); begin += entries)
+        {
+            ExecuteWindow(&batch[begin], std::min<size_t>(entries, batch.size() - begin));
+        }
+    }
+
+    // Opens the window's files, reads/writes/stats them through the ring, then closes the files
+    void ExecuteWindow(IORequest* window, size_t count)
+    {
+        std::vector<int> results;
+        std::vector<int> fds(count, -1);
+        std::vector<struct statx> stats(count);
+
+        Run(count, [&](io_uring_sqe& sqe, size_t i)
+        {
+            const IORequest& request = window[i];
+            sqe.fd = AT_FDCWD;
+            sqe.addr = reinterpret_cast<uint64_t>(request.path.c_str());
+            if (request.type == IORequest::Type::Stat)
+            {
+                sqe.opcode = IORING_OP_STATX;
+                sqe.len = STATX_SIZE | STATX_MTIME;
+                sqe.off = reinterpret_cast<uint64_t>(&stats[i]);
+            }
+            else
+            {
+                sqe.opcode = IORING_OP_OPENAT;
+                sqe.open_flags = request.type == IORequest::Type::Read ? O_RDONLY | O_CLOEXEC : O_WRONLY | O_CREAT | O_CLOEXEC;
+                sqe.len = 0644;
+            }
+        }, results);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (window[i].type == IORequest::Type::Stat)
+            {
+                window[i].result = results[i] == 0 ? static_cast<int64_t>(stats[i].stx_size) : -1;
+                window[i].modifiedTime = static_cast<int64_t>(stats[i].stx_mtime.tv_sec) * 1000000000 + stats[i].stx_mtime.tv_nsec;
+            }
+            else
+            {
+                fds[i] = results[i];
+            }
+        }
+
+        // Transfers of up to 1GB go through the ring, the rest is finished synchronously below
+        std::vector<size_t> transfers;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (fds[i] >= 0)
+            {
+                transfers.push_back(i);
+            }
+        }
+
+        Run(transfers.size(), [&](io_uring_sqe& sqe, size_t t)
+        {
+            const IORequest& request = window[transfers[t]];
+            sqe.opcode = request.type == IORequest::Type::Read ? IORING_OP_READ : IORING_OP_WRITE;
+            sqe.fd = fds[transfers[t]];
+            sqe.addr = reinterpret_cast<uint64_t>(request.buffer);
+            sqe.len = static_cast<uint32_t>(std::min<size_t>(request.size, 1u << 30));
+            sqe.off = request.offset;
+        }, results);
+
+        for (size_t t = 0; t < transfers.size(); ++t)
+        {
+            window[transfers[t]].result = std::max(results[t], -1);
+        }
+
+        Run(transfers.size(), [&](io_uring_sqe& sqe, size_t t)
+        {
+            sqe.opcode = IORING_OP_CLOSE;
+            sqe.fd = fds[transfers[t]];
+        }, results);
+
+        for (size_t t = 0; t < transfers.size(); ++t)
+        {
+            if (results[t] < 0)
+            {
+                close(fds[transfers[t]]);
+            }
+        }
+    }
+};
+#else
+struct AsyncIO::IoUring
+{
+};
+#endif
+
+AsyncIO::AsyncIO(unsigned int workerCount) : stopping(false)
+{
+#ifdef LEVEL_HAS_IO_URING
+    std::unique_ptr<IoUring> candidate(new IoUring());
+    if (candidate->Init(256))
+    {
+        ring = std::move(candidate);
+    }
+#endif
+
+    // I/O workers mostly wait on the disk, so there are more of them than cores
+    if (workerCount == 0)
+    {
+        workerCount = std::max(4u, std::thread::hardware_concurrency() * 2);
+    }
+
+    for (unsigned int i = 0; i < workerCount; ++i)
+    {
+        workers.emplace_back(&AsyncIO::WorkerLoop, this);
+    }
+}
+
+AsyncIO::~AsyncIO()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+AsyncIO& AsyncIO::Default()
+{
+    static AsyncIO instance;
+    return instance;
+}
+
+bool AsyncIO::Execute(std::vector<IORequest>& batch)
+{
+    if (batch.empty())
+    {
+        return true;
+    }
+
+#ifdef LEVEL_HAS_IO_URING
+    if (ring)
+    {
+        {
+            std::lock_guard<std::mutex> lock(ringMutex);
+            ring->Execute(batch);
+        }
+
+        // Anything the ring could not finish (old kernels, short transfers) is redone on the pool
+        std::vector<IORequest> retries;
+        std::vector<size_t> retryIndices;
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            if (!batch[i].Succeeded())
+            {
+                retries.push_back(batch[i]);
+                retryIndices.push_back(i);
+            }
+        }
+
+        bool succeeded = retries.empty() || ExecuteOnPool(retries);
+        for (size_t i = 0; i < retries.size(); ++i)
+        {
+            batch[retryIndices[i]].result = retries[i].result;
+        }
+        return succeeded;
+    }
+#endif
+
+    return ExecuteOnPool(batch);
+}
+
+bool AsyncIO::IsUsingIoUring() const
+{
+    return ring != nullptr;
+}
+
+bool AsyncIO::ExecuteOnPool(std::vector<IORequest>& batch)
+{
+    Batch state;
+    state.remaining = batch.size();
+
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        for (auto& request : batch)
+        {
+            jobs.push_back(Job{ &request, &state });
+        }
+    }
+    jobAvailable.notify_all();
+
+    {
+        std::unique_lock<std::mutex> lock(state.mutex);
+        state.done.wait(lock, [&state]() { return state.remaining == 0; });
+    }
+
+    for (const auto& request : batch)
+    {
+        if (!request.Succeeded())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void AsyncIO::WorkerLoop()
+{
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+            {
+                return;
+            }
+            job = jobs.front();
+            jobs.pop_front();
+        }
+
+        ExecuteSync(*job.request);
+
+        // The waiting thread owns the batch, signal under its lock so it cannot go away mid-notify
+        std::lock_guard<std::mutex> lock(job.batch->mutex);
+        if (--job.batch->remaining == 0)
+        {
+            job.batch->done.notify_all();
+        }
+    }
+}
@@ -0,0 +1,236 @@
+#include "BlockCodec.h"
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace
+{
+    const size_t MinMatch = 4;
+    const size_t LastLiterals = 5;      // The block always ends with at least this many literals
+    const size_t MatchSearchLimit = 12; // No match may start closer than this to the end
+    const size_t MaxOffset = 65535;
+    const int HashLog = 16;
+
+    inline uint32_t Read32(const unsigned char* bytes)
+    {
+        uint32_t value;
+        memcpy(&value, bytes, sizeof(value));
+        return value;
+    }
+
+    inline uint32_t HashPosition(const unsigned char* bytes)
+    {
+        return (Read32(bytes) * 2654435761u) >> (32 - HashLog);
+    }
+
+    // Writes the 255-byte continuation of a length that did not fit in its token nibble
+    inline unsigned char* WriteLength(unsigned char* op, size_t length)
+    {
+        for (; length >= 255; length -= 255)
+        {
+            *op++ = 255;
+        }
+        *op++ = static_cast<unsigned char>(length);
+        return op;
+    }
+
+    // Emits one sequence, a null match means the final literal-only sequence
+    inline unsigned char* WriteSequence(unsigned char* op, const unsigned char* outputEnd, const unsigned char* literals, size_t literalLength,
+        size_t offset, size_t matchLength)
+    {
+        size_t worstCase = 1 + literalLength / 255 + 1 + literalLength + 2 + matchLength / 255 + 1;
+        if (static_cast<size_t>(outputEnd - op) < worstCase)
+        {
+            return nullptr;
+        }
+
+        unsigned char* token = op++;
+        *token = static_cast<unsigned char>((literalLength >= 15 ? 15 : literalLength) << 4);
+        if (literalLength >= 15)
+        {
+            op = WriteLength(op, literalLength - 15);
+        }
+        memcpy(op, literals, literalLength);
+        op += literalLength;
+
+        if (matchLength == 0)
+        {
+            return op;
+        }
+
+        *op++ = static_cast<unsigned char>(offset);
+        *op++ = static_cast<unsigned char>(offset >> 8);
+
+        size_t matchCode = matchLength - MinMatch;
+        *token |= static_cast<unsigned char>(matchCode >= 15 ? 15 : matchCode);
+        if (matchCode >= 15)
+        {
+            op = WriteLength(op, matchCode - 15);
+        }
+        return op;
+    }
+
+    // Reads the 255-byte continuation of a length, false if the input runs out
+    inline bool ReadLength(const unsigned char*& ip, const unsigned char* inputEnd, size_t& length)
+    {
+        unsigned char byte;
+        do
+        {
+            if (ip >= inputEnd)
+            {
+                return false;
+            }
+            byte = *ip++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+}
+
+size_t BlockCodec::GetMaxCompressedSize(size_t srcSize)
+{
+    return srcSize + srcSize / 255 + 16;
+}
+
+size_t BlockCodec::Compress(const void* src, size_t srcSize, void* dst, size_t dstCapacity)
+{
+    // Positions are kept as 32-bit offsets
+    if (srcSize > UINT32_MAX)
+    {
+        return 0;
+    }
+
+    const unsigned char* input = static_cast<const unsigned char*>(src);
+    const unsigned char* inputEnd = input + srcSize;
+    const unsigned char* anchor = input;
+    unsigned char* op = static_cast<unsigned char*>(dst);
+    const unsigned char* outputEnd = op + dstCapacity;
+
+    if (srcSize > MatchSearchLimit)
+    {
+        // Last position seen for each 4-byte hash, as an offset from input
+        std::unique_ptr<uint32_t[]> table(new uint32_t[size_t(1) << HashLog]());
+        const unsigned char* matchLimit = inputEnd - LastLiterals;
+        const unsigned char* searchLimit = inputEnd - MatchSearchLimit;
+
+        const unsigned char* ip = input + 1;
+        size_t misses = 0;
+        while (ip <= searchLimit)
+        {
+            uint32_t hash = HashPosition(ip);
+            const unsigned char* candidate = input + table[hash];
+            table[hash] = static_cast<uint32_t>(ip - input);
+
+            if (candidate >= ip || static_cast<size_t>(ip - candidate) > MaxOffset || Read32(candidate) != Read32(ip))
+            {
+                // Skip ahead faster through data that does not compress
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+
+            // Grow the match backwards over pending literals, then forwards
+            while (ip > anchor && candidate > input && ip[-1] == candidate[-1])
+            {
+                --ip;
+                --candidate;
+            }
+
+            const unsigned char* matchEnd = ip + MinMatch;
+            const unsigned char* reference = candidate + MinMatch;
+            while (matchEnd < matchLimit && *matchEnd == *reference)
+            {
+                ++matchEnd;
+                ++reference;
+            }
+
+            op = WriteSequence(op, outputEnd, anchor, ip - anchor, ip - candidate, matchEnd - ip);
+            if (!op)
+            {
+                return 0;
+            }
+
+            ip = matchEnd;
+            anchor = ip;
+            if (ip - 2 > input)
+            {
+                table[HashPosition(ip - 2)] = static_cast<uint32_t>(ip - 2 - input);
+            }
+        }
+    }
+
+    op = WriteSequence(op, outputEnd, anchor, inputEnd - anchor, 0, 0);
+    return op ? static_cast<size_t>(op - static_cast<unsigned char*>(dst)) : 0;
+}
+
+bool BlockCodec::Decompress(const void* src, size_t srcSize, void* dst, size_t dstSize)
+{
+    const unsigned char* ip = static_cast<const unsigned char*>(src);
+    const unsigned char* inputEnd = ip + srcSize;
+    unsigned char* output = static_cast<unsigned char*>(dst);
+    unsigned char* op = output;
+    unsigned char* outputEnd = output + dstSize;
+
+    while (ip < inputEnd)
+    {
+        unsigned char token = *ip++;
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !ReadLength(ip, inputEnd, literalLength))
+        {
+            return false;
+        }
+        if (literalLength > static_cast<size_t>(inputEnd - ip) || literalLength > static_cast<size_t>(outputEnd - op))
+        {
+            return false;
+        }
+        memcpy(op, ip, literalLength);
+        op += literalLength;
+        ip += literalLength;
+
+        // The final sequence has literals only
+        if (ip == inputEnd)
+        {
+            break;
+        }
+
+        if (inputEnd - ip < 2)
+        {
+            return false;
+        }
+        size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<size_t>(op - output))
+        {
+            return false;
+        }
+
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !ReadLength(ip, inputEnd, matchLength))
+        {
+            return false;
+        }
+        matchLength += MinMatch;
+        if (matchLength > static_cast<size_t>(outputEnd - op))
+        {
+            return false;
+        }
+
+        // Overlapping matches repeat the last offset bytes, so they are copied forwards byte by byte
+        const unsigned char* match = op - offset;
+        if (offset >= matchLength)
+        {
+            memcpy(op, match, matchLength);
+            op += matchLength;
+        }
+        else
+        {
+            for (size_t i = 0; i < matchLength; ++i)
+            {
+                *op++ = *match++;
+            }
+        }
+    }
+
+    return op == outputEnd;
+}
@@ -0,0 +1,91 @@
+#include "ChunkAllocator.h"
+#include "Metrics.h"
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+
+namespace
+{
+    // Stored right before every heap block, the aligned block can sit anywhere inside the malloc'd range
+    struct HeapBlockHeader
+    {
+        void* allocation;
+        size_t size;
+    };
+}
+
+void ChunkAllocator::WriteStatsJson(JsonWriter& json) const
+{
+    json.BeginObject();
+    WriteStatsFields(json, GetStats());
+    json.EndObject();
+}
+
+void ChunkAllocator::WriteStatsFields(JsonWriter& json, const Stats& stats)
+{
+    json.Key("allocations").Value(stats.allocations);
+    json.Key("frees").Value(stats.frees);
+    json.Key("failedAllocations").Value(stats.failedAllocations);
+    json.Key("bytesInUse").Value(stats.bytesInUse);
+    json.Key("highWaterMark").Value(stats.highWaterMark);
+    json.Key("capacity").Value(stats.capacity);
+}
+
+HeapChunkAllocator::HeapChunkAllocator() : allocations(0), frees(0), failedAllocations(0), bytesInUse(0), highWaterMark(0)
+{
+}
+
+void* HeapChunkAllocator::Allocate(size_t size, size_t alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0 && "HeapChunkAllocator: Alignment must be a power of two.");
+    if (alignment < alignof(HeapBlockHeader))
+    {
+        alignment = alignof(HeapBlockHeader);
+    }
+
+    size_t padding = sizeof(HeapBlockHeader) + alignment - 1;
+    void* allocation = size <= SIZE_MAX - padding ? malloc(size + padding) : nullptr;
+    if (!allocation)
+    {
+        ++failedAllocations;
+        return nullptr;
+    }
+
+    uintptr_t address = (reinterpret_cast<uintptr_t>(allocation) + sizeof(HeapBlockHeader) + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+    HeapBlockHeader* header = reinterpret_cast<HeapBlockHeader*>(address) - 1;
+    header->allocation = allocation;
+    header->size = size;
+
+    ++allocations;
+    size_t inUse = bytesInUse += size;
+    size_t previousMax = highWaterMark.load(std::memory_order_relaxed);
+    while (inUse > previousMax && !highWaterMark.compare_exchange_weak(previousMax, inUse, std::memory_order_relaxed))
+    {
+    }
+    return reinterpret_cast<void*>(address);
+}
+
+void HeapChunkAllocator::Free(void* block)
+{
+    if (!block)
+    {
+        return;
+    }
+
+    HeapBlockHeader* header = static_cast<HeapBlockHeader*>(block) - 1;
+    bytesInUse -= header->size;
+    ++frees;
+    free(header->allocation);
+}
+
+ChunkAllocator::Stats HeapChunkAllocator::GetStats() const
+{
+    Stats stats;
+    stats.allocations = allocations;
+    stats.frees = frees;
+    stats.failedAllocations = failedAllocations;
+    stats.bytesInUse = bytesInUse;
+    stats.highWaterMark = highWaterMark;
+    stats.capacity = 0;
+    return stats;
+}
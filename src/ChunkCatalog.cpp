@@ -0,0 +1,133 @@
+#include "ChunkCatalog.h"
+#include "AsyncIO.h"
+
+ChunkCatalog& ChunkCatalog::Instance()
+{
+    static ChunkCatalog catalog;
+    return catalog;
+}
+
+std::vector<size_t> ChunkCatalog::GetSizes(const std::vector<std::string>& paths)
+{
+    std::vector<size_t> sizes(paths.size(), 0);
+
+    // Answer what the catalog knows, collect the rest for one stat batch
+    std::vector<size_t> missing;
+    std::vector<IORequest> stats;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            auto found = entries.find(paths[i]);
+            if (found != entries.end())
+            {
+                sizes[i] = static_cast<size_t>(found->second.size);
+            }
+            else
+            {
+                missing.push_back(i);
+                stats.push_back(IORequest::Stat(paths[i]));
+            }
+        }
+    }
+    if (stats.empty())
+    {
+        return sizes;
+    }
+
+    // The stats run without the lock, a concurrent lookup of the same file at worst stats it twice
+    AsyncIO::Default().Execute(stats);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t m = 0; m < missing.size(); ++m)
+    {
+        if (stats[m].Succeeded())
+        {
+            sizes[missing[m]] = static_cast<size_t>(stats[m].result);
+            entries[stats[m].path] = Entry{ static_cast<uint64_t>(stats[m].result), stats[m].modifiedTime };
+        }
+    }
+    return sizes;
+}
+
+std::vector<std::string> ChunkCatalog::Refresh()
+{
+    std::vector<std::string> paths;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        paths.reserve(entries.size());
+        for (const auto& entry : entries)
+        {
+            paths.push_back(entry.first);
+        }
+    }
+    return Refresh(paths);
+}
+
+std::vector<std::string> ChunkCatalog::Refresh(const std::vector<std::string>& paths)
+{
+    std::vector<IORequest> stats;
+    stats.reserve(paths.size());
+    for (const auto& path : paths)
+    {
+        stats.push_back(IORequest::Stat(path));
+    }
+    AsyncIO::Default().Execute(stats);
+
+    std::vector<std::string> changed;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& stat : stats)
+    {
+        auto found = entries.find(stat.path);
+        if (found == entries.end())
+        {
+            if (stat.Succeeded())
+            {
+                entries[stat.path] = Entry{ static_cast<uint64_t>(stat.result), stat.modifiedTime };
+            }
+            continue;
+        }
+
+        if (!stat.Succeeded())
+        {
+            entries.erase(found);
+            changed.push_back(stat.path);
+        }
+        else if (found->second.size != static_cast<uint64_t>(stat.result) || found->second.modifiedTime != stat.modifiedTime)
+        {
+            found->second = Entry{ static_cast<uint64_t>(stat.result), stat.modifiedTime };
+            changed.push_back(stat.path);
+        }
+    }
+    return changed;
+}
+
+void ChunkCatalog::Invalidate(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.erase(path);
+}
+
+void ChunkCatalog::Clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+}
+
+bool ChunkCatalog::Find(const std::string& path, Entry& entry) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = entries.find(path);
+    if (found == entries.end())
+    {
+        return false;
+    }
+    entry = found->second;
+    return true;
+}
+
+size_t ChunkCatalog::GetEntryCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
@@ -0,0 +1,297 @@
+#include "ChunkPrefetcher.h"
+#include "AsyncIO.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <unordered_set>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+ChunkPrefetcher::ChunkPrefetcher(size_t window, size_t stagingLimit)
+    : stopping(false), window(window), stagingLimit(stagingLimit), stats()
+{
+    worker = std::thread(&ChunkPrefetcher::WorkerLoop, this);
+}
+
+ChunkPrefetcher::~ChunkPrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    workAvailable.notify_one();
+    worker.join();
+}
+
+void ChunkPrefetcher::SetWindow(size_t chunkCount)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    window = chunkCount;
+}
+
+size_t ChunkPrefetcher::GetWindow() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return window;
+}
+
+void ChunkPrefetcher::Prefetch(const std::vector<Request>& upcoming)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t count = std::min(window, upcoming.size());
+
+    // Whatever is staged for files that are no longer coming up only takes memory
+    std::unordered_set<std::string> wanted;
+    for (size_t i = 0; i < count; ++i)
+    {
+        wanted.insert(upcoming[i].path);
+    }
+    for (auto it = entries.begin(); it != entries.end();)
+    {
+        auto current = it++;
+        if (!wanted.count(current->first))
+        {
+            Drop(current);
+        }
+    }
+
+    bool queued = false;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Request& request = upcoming[i];
+        auto existing = entries.find(request.path);
+        if (existing != entries.end())
+        {
+            // A file dropped while it was being read is wanted again after all
+            existing->second.abandoned = false;
+            continue;
+        }
+
+        // Files past the staging limit are only hinted, nearer files are staged first
+        Entry& entry = entries[request.path];
+        entry.size = request.size;
+        entry.abandoned = false;
+        entry.modifiedTime = 0;
+        if (request.stage && stats.stagingBytes + request.size <= stagingLimit)
+        {
+            entry.state = EntryState::QueuedRead;
+            stats.stagingBytes += request.size;
+        }
+        else
+        {
+            entry.state = EntryState::QueuedHint;
+        }
+        queue.push_back(request.path);
+        queued = true;
+    }
+
+    if (queued)
+    {
+        workAvailable.notify_one();
+    }
+}
+
+bool ChunkPrefetcher::Take(const std::string& path, std::vector<char>& bytes)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    auto entry = entries.find(path);
+    if (entry != entries.end() && entry->second.state == EntryState::Reading)
+    {
+        // The read is under way, finishing it is quicker than starting another
+        entry->second.abandoned = false;
+        readDone.wait(lock, [&]() { return entry->second.state != EntryState::Reading; });
+    }
+
+    // One stat instead of an open and a read, the bytes only count if the file is as it was before the read
+    bool unchanged = false;
+    if (entry != entries.end() && entry->second.state == EntryState::Staged)
+    {
+        IORequest stat = IORequest::Stat(path);
+        AsyncIO::ExecuteSync(stat);
+        unchanged = stat.Succeeded() && static_cast<size_t>(stat.result) == entry->second.size && stat.modifiedTime == entry->second.modifiedTime;
+    }
+
+    if (!unchanged)
+    {
+        if (entry != entries.end())
+        {
+            Drop(entry);
+        }
+        ++stats.misses;
+        return false;
+    }
+
+    bytes.swap(entry->second.bytes);
+    stats.stagingBytes -= entry->second.size;
+    entries.erase(entry);
+    ++stats.hits;
+    return true;
+}
+
+void ChunkPrefetcher::Clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = entries.begin(); it != entries.end();)
+    {
+        auto current = it++;
+        Drop(current);
+    }
+    queue.clear();
+}
+
+bool ChunkPrefetcher::Drop(std::unordered_map<std::string, Entry>::iterator entry)
+{
+    if (entry->second.state == EntryState::Reading)
+    {
+        entry->second.abandoned = true;
+        return false;
+    }
+
+    if (entry->second.state == EntryState::Staged)
+    {
+        ++stats.wasted;
+    }
+    if (entry->second.state == EntryState::Staged || entry->second.state == EntryState::QueuedRead)
+    {
+        stats.stagingBytes -= entry->second.size;
+    }
+    entries.erase(entry);
+    return true;
+}
+
+void ChunkPrefetcher::WorkerLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        workAvailable.wait(lock, [this]() { return stopping || !queue.empty(); });
+        if (stopping)
+        {
+            return;
+        }
+
+        // Everything queued goes out as one batch, paths dropped or taken since are skipped
+        std::vector<Request> hints;
+        std::vector<IORequest> reads;
+        std::vector<Entry*> reading;
+        while (!queue.empty())
+        {
+            std::string path = std::move(queue.front());
+            queue.pop_front();
+            auto entry = entries.find(path);
+            if (entry == entries.end() || (entry->second.state != EntryState::QueuedHint && entry->second.state != EntryState::QueuedRead))
+            {
+                continue;
+            }
+
+            hints.push_back(Request{ path, entry->second.size, false });
+            if (entry->second.state == EntryState::QueuedRead)
+            {
+                // Reading entries are never erased by the other thread, so the buffer stays put while unlocked
+                entry->second.state = EntryState::Reading;
+                entry->second.bytes.resize(entry->second.size);
+                reads.push_back(IORequest::Read(path, entry->second.bytes.data(), entry->second.size, 0));
+                reading.push_back(&entry->second);
+            }
+            else
+            {
+                entry->second.state = EntryState::Hinted;
+            }
+        }
+        lock.unlock();
+
+        // Hints first, the OS reads all of them while the staged reads run
+        for (const auto& hint : hints)
+        {
+            AdviseWillNeed(hint.path, hint.size);
+        }
+        std::vector<IORequest> fileStats(reads.size());
+        for (size_t i = 0; i < reads.size(); ++i)
+        {
+            fileStats[i] = IORequest::Stat(reads[i].path);
+            AsyncIO::ExecuteSync(fileStats[i]);
+        }
+        AsyncIO::Default().Execute(reads);
+
+        lock.lock();
+        stats.hints += hints.size();
+        for (size_t i = 0; i < reads.size(); ++i)
+        {
+            Entry& entry = *reading[i];
+            entry.modifiedTime = fileStats[i].modifiedTime;
+            bool staged = fileStats[i].Succeeded() && reads[i].Succeeded() && static_cast<size_t>(reads[i].result) == entry.size;
+            entry.state = staged ? EntryState::Staged : EntryState::Failed;
+            if (staged)
+            {
+                stats.bytesStaged += entry.size;
+            }
+            else
+            {
+                ++stats.failed;
+                stats.stagingBytes -= entry.size;
+                entry.bytes = std::vector<char>();
+                LOG_DEBUG("Prefetch of " << reads[i].path << " failed.");
+            }
+        }
+
+        // Entries dropped while they were read go now
+        for (size_t i = 0; i < reads.size(); ++i)
+        {
+            if (reading[i]->abandoned)
+            {
+                Drop(entries.find(reads[i].path));
+            }
+        }
+        readDone.notify_all();
+    }
+}
+
+ChunkPrefetcher::Stats ChunkPrefetcher::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void ChunkPrefetcher::ResetStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t stagingBytes = stats.stagingBytes;
+    stats = Stats();
+    stats.stagingBytes = stagingBytes;
+}
+
+void ChunkPrefetcher::WriteStatsJson(JsonWriter& json) const
+{
+    Stats current = GetStats();
+    json.BeginObject();
+    json.Key("window").Value(GetWindow());
+    json.Key("hits").Value(current.hits);
+    json.Key("misses").Value(current.misses);
+    json.Key("hints").Value(current.hints);
+    json.Key("wasted").Value(current.wasted);
+    json.Key("failed").Value(current.failed);
+    json.Key("bytesStaged").Value(current.bytesStaged);
+    json.Key("stagingBytes").Value(current.stagingBytes);
+    json.EndObject();
+}
+
+void ChunkPrefetcher::AdviseWillNeed(const std::string& path, size_t size)
+{
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+    // The OS keeps reading ahead after the descriptor is closed
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return;
+    }
+    posix_fadvise(fd, 0, static_cast<off_t>(size), POSIX_FADV_WILLNEED);
+    close(fd);
+#else
+    // No portable hint here, the staged reads warm the cache on their own
+    (void)path;
+    (void)size;
+#endif
+}
@@ -0,0 +1,222 @@
+#include "ChunkResidency.h"
+#include "Metrics.h"
+
+ChunkResidency::ChunkResidency()
+    : head(-1), tail(-1), budget(0), residentBytes(0), residentChunks(0), peakResidentBytes(0), hits(0), faults(0), evictions(0)
+{
+}
+
+void ChunkResidency::SetBudget(size_t bytes)
+{
+    budget = bytes;
+}
+
+size_t ChunkResidency::GetBudget() const
+{
+    return budget;
+}
+
+bool ChunkResidency::IsOverBudget() const
+{
+    return budget != 0 && residentBytes > budget;
+}
+
+void ChunkResidency::Resize(size_t chunkCount)
+{
+    for (size_t i = chunkCount; i < states.size(); ++i)
+    {
+        Remove(static_cast<int>(i));
+    }
+    previous.resize(chunkCount, -1);
+    next.resize(chunkCount, -1);
+    sizes.resize(chunkCount, 0);
+    states.resize(chunkCount, State::Absent);
+}
+
+void ChunkResidency::Clear()
+{
+    previous.assign(previous.size(), -1);
+    next.assign(next.size(), -1);
+    sizes.assign(sizes.size(), 0);
+    states.assign(states.size(), State::Absent);
+    head = -1;
+    tail = -1;
+    residentBytes = 0;
+    residentChunks = 0;
+}
+
+bool ChunkResidency::Touch(int chunkIndex)
+{
+    if (!IsResident(chunkIndex))
+    {
+        return false;
+    }
+
+    ++hits;
+    if (chunkIndex != tail)
+    {
+        Unlink(chunkIndex);
+        Link(chunkIndex);
+    }
+    return true;
+}
+
+void ChunkResidency::Insert(int chunkIndex, size_t size)
+{
+    if (chunkIndex < 0)
+    {
+        return;
+    }
+    if (static_cast<size_t>(chunkIndex) >= states.size())
+    {
+        Resize(chunkIndex + 1);
+    }
+
+    if (states[chunkIndex] == State::Resident)
+    {
+        Unlink(chunkIndex);
+    }
+    else if (states[chunkIndex] == State::Evicted)
+    {
+        ++faults;
+    }
+
+    sizes[chunkIndex] = size;
+    states[chunkIndex] = State::Resident;
+    Link(chunkIndex);
+    if (residentBytes > peakResidentBytes)
+    {
+        peakResidentBytes = residentBytes;
+    }
+}
+
+void ChunkResidency::Evict(int chunkIndex)
+{
+    if (!IsResident(chunkIndex))
+    {
+        return;
+    }
+
+    Unlink(chunkIndex);
+    states[chunkIndex] = State::Evicted;
+    ++evictions;
+}
+
+void ChunkResidency::Remove(int chunkIndex)
+{
+    if (chunkIndex < 0 || static_cast<size_t>(chunkIndex) >= states.size())
+    {
+        return;
+    }
+
+    if (states[chunkIndex] == State::Resident)
+    {
+        Unlink(chunkIndex);
+    }
+    states[chunkIndex] = State::Absent;
+}
+
+bool ChunkResidency::IsResident(int chunkIndex) const
+{
+    return chunkIndex >= 0 && static_cast<size_t>(chunkIndex) < states.size() && states[chunkIndex] == State::Resident;
+}
+
+bool ChunkResidency::IsEvicted(int chunkIndex) const
+{
+    return chunkIndex >= 0 && static_cast<size_t>(chunkIndex) < states.size() && states[chunkIndex] == State::Evicted;
+}
+
+int ChunkResidency::GetLeastRecent() const
+{
+    return head;
+}
+
+int ChunkResidency::GetNewer(int chunkIndex) const
+{
+    return IsResident(chunkIndex) ? next[chunkIndex] : -1;
+}
+
+size_t ChunkResidency::GetResidentBytes() const
+{
+    return residentBytes;
+}
+
+ChunkResidency::Stats ChunkResidency::GetStats() const
+{
+    Stats stats;
+    stats.hits = hits;
+    stats.faults = faults;
+    stats.evictions = evictions;
+    stats.residentBytes = residentBytes;
+    stats.residentChunks = residentChunks;
+    stats.peakResidentBytes = peakResidentBytes;
+    stats.budget = budget;
+    return stats;
+}
+
+void ChunkResidency::ResetStats()
+{
+    hits = 0;
+    faults = 0;
+    evictions = 0;
+    peakResidentBytes = residentBytes;
+}
+
+void ChunkResidency::WriteStatsJson(JsonWriter& json) const
+{
+    Stats stats = GetStats();
+    json.BeginObject();
+    json.Key("budget").Value(stats.budget);
+    json.Key("residentBytes").Value(stats.residentBytes);
+    json.Key("residentChunks").Value(stats.residentChunks);
+    json.Key("peakResidentBytes").Value(stats.peakResidentBytes);
+    json.Key("hits").Value(static_cast<unsigned long long>(stats.hits));
+    json.Key("faults").Value(static_cast<unsigned long long>(stats.faults));
+    json.Key("evictions").Value(static_cast<unsigned long long>(stats.evictions));
+    json.EndObject();
+}
+
+void ChunkResidency::Link(int chunkIndex)
+{
+    previous[chunkIndex] = tail;
+    next[chunkIndex] = -1;
+    if (tail != -1)
+    {
+        next[tail] = chunkIndex;
+    }
+    else
+    {
+        head = chunkIndex;
+    }
+    tail = chunkIndex;
+
+    residentBytes += sizes[chunkIndex];
+    ++residentChunks;
+}
+
+void ChunkResidency::Unlink(int chunkIndex)
+{
+    int before = previous[chunkIndex];
+    int after = next[chunkIndex];
+    if (before != -1)
+    {
+        next[before] = after;
+    }
+    else
+    {
+        head = after;
+    }
+    if (after != -1)
+    {
+        previous[after] = before;
+    }
+    else
+    {
+        tail = before;
+    }
+    previous[chunkIndex] = -1;
+    next[chunkIndex] = -1;
+
+    residentBytes -= sizes[chunkIndex];
+    --residentChunks;
+}
@@ -0,0 +1,304 @@
+#include "ChunkStore.h"
+#include <cstring>
+#include <new>
+#include <vector>
+
+namespace
+{
+    const uint64_t Prime1 = 11400714785074694791ULL;
+    const uint64_t Prime2 = 14029467366897019727ULL;
+    const uint64_t Prime3 = 1609587929392839161ULL;
+    const uint64_t Prime4 = 9650029242287828579ULL;
+    const uint64_t Prime5 = 2870177450012600261ULL;
+
+    inline uint64_t RotateLeft(uint64_t value, int bits)
+    {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    inline uint64_t Read64(const unsigned char* bytes)
+    {
+        uint64_t value;
+        memcpy(&value, bytes, sizeof(value));
+        return value;
+    }
+
+    inline uint32_t Read32(const unsigned char* bytes)
+    {
+        uint32_t value;
+        memcpy(&value, bytes, sizeof(value));
+        return value;
+    }
+
+    inline uint64_t Round(uint64_t accumulator, uint64_t input)
+    {
+        accumulator += input * Prime2;
+        accumulator = RotateLeft(accumulator, 31);
+        return accumulator * Prime1;
+    }
+
+    inline uint64_t MergeRound(uint64_t hash, uint64_t lane)
+    {
+        hash ^= Round(0, lane);
+        return hash * Prime1 + Prime4;
+    }
+}
+
+ChunkStore::ChunkStore()
+    : shards(std::make_shared<ShardArray>()), storedBytes(std::make_shared<std::atomic<size_t>>(0)),
+      heapAllocator(std::make_shared<HeapChunkAllocator>()), dedupHits(0), allocatorFallbacks(0)
+{
+    allocator = heapAllocator;
+}
+
+ChunkStore& ChunkStore::Instance()
+{
+    static ChunkStore instance;
+    return instance;
+}
+
+std::shared_ptr<const ChunkStore::Blob> ChunkStore::Intern(const void* data, size_t size)
+{
+    uint64_t hash = Hash(data, size);
+    std::shared_ptr<const Blob> existing = Find(hash, data, size);
+    if (existing)
+    {
+        ++dedupHits;
+        return existing;
+    }
+
+    // Allocating and copying need no lock, the blob is nobody else's until it is inserted
+    PendingBlob pending = Reserve(size);
+    if (!pending)
+    {
+        throw std::bad_alloc();
+    }
+    memcpy(pending.GetData(), data, size);
+    pending.blob->hash = hash;
+    return Insert(std::move(pending.blob));
+}
+
+ChunkStore::PendingBlob ChunkStore::Reserve(size_t size)
+{
+    std::shared_ptr<ChunkAllocator> owner = GetAllocator();
+    void* bytes = owner->Allocate(size > 0 ? size : 1);
+    if (!bytes && owner != heapAllocator)
+    {
+        // A full arena must not fail the load, the heap takes the blob
+        owner = heapAllocator;
+        bytes = owner->Allocate(size > 0 ? size : 1);
+        ++allocatorFallbacks;
+    }
+    if (!bytes)
+    {
+        return PendingBlob();
+    }
+
+    // The deleter only touches the byte counter, its shard and the allocator, all outlive the store through their
+    // shared_ptrs. Blobs that were never inserted have no index entry to erase.
+    std::shared_ptr<std::atomic<size_t>> counter = storedBytes;
+    std::shared_ptr<ShardArray> index = shards;
+    std::shared_ptr<Blob> blob(new Blob(0, size, static_cast<char*>(bytes)), [counter, index, owner](Blob* released)
+    {
+        Shard& shard = GetShard(*index, released->hash);
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto entries = shard.blobs.equal_range(released->hash);
+            for (auto it = entries.first; it != entries.second; ++it)
+            {
+                if (it->second.blob == released)
+                {
+                    shard.blobs.erase(it);
+                    break;
+                }
+            }
+        }
+
+        *counter -= released->GetSize();
+        owner->Free(released->data);
+        delete released;
+    });
+    *storedBytes += size;
+    return PendingBlob(std::move(blob));
+}
+
+std::shared_ptr<const ChunkStore::Blob> ChunkStore::Commit(PendingBlob pending)
+{
+    if (!pending)
+    {
+        return nullptr;
+    }
+
+    uint64_t hash = Hash(pending.GetData(), pending.GetSize());
+    std::shared_ptr<const Blob> existing = Find(hash, pending.GetData(), pending.GetSize());
+    if (existing)
+    {
+        ++dedupHits;
+        return existing;
+    }
+
+    pending.blob->hash = hash;
+    return Insert(std::move(pending.blob));
+}
+
+std::shared_ptr<const ChunkStore::Blob> ChunkStore::Find(uint64_t hash, const void* data, size_t size)
+{
+    // References taken under the lock are dropped after it, the last one going away runs a deleter that takes it
+    std::vector<std::shared_ptr<const Blob>> candidates;
+    {
+        Shard& shard = GetShard(*shards, hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto entries = shard.blobs.equal_range(hash);
+        for (auto it = entries.first; it != entries.second; ++it)
+        {
+            candidates.push_back(it->second.reference.lock());
+        }
+    }
+
+    // A hash match is only a hint, the bytes decide. Blob bytes never change, so no lock is needed here.
+    for (const auto& blob : candidates)
+    {
+        if (blob && blob->GetSize() == size && memcmp(blob->GetData(), data, size) == 0)
+        {
+            return blob;
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<const ChunkStore::Blob> ChunkStore::Insert(std::shared_ptr<Blob> blob)
+{
+    // A live blob of the same hash and size means another thread interned the same bytes since Find missed,
+    // only that race compares bytes under the lock
+    std::vector<std::shared_ptr<const Blob>> candidates;
+    std::shared_ptr<const Blob> existing;
+    {
+        Shard& shard = GetShard(*shards, blob->hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto entries = shard.blobs.equal_range(blob->hash);
+        for (auto it = entries.first; it != entries.second && !existing; ++it)
+        {
+            candidates.push_back(it->second.reference.lock());
+            const Blob* candidate = candidates.back().get();
+            if (candidate && candidate->GetSize() == blob->size && memcmp(candidate->GetData(), blob->data, blob->size) == 0)
+            {
+                existing = candidates.back();
+            }
+        }
+        if (!existing)
+        {
+            shard.blobs.emplace(blob->hash, Shard::Entry{ blob.get(), blob });
+        }
+    }
+
+    // The new blob is dropped on return, its memory goes back to the allocator
+    if (existing)
+    {
+        ++dedupHits;
+        return existing;
+    }
+    return blob;
+}
+
+uint64_t ChunkStore::Hash(const void* data, size_t size, uint64_t seed)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    const unsigned char* end = bytes + size;
+    uint64_t hash;
+
+    if (size >= 32)
+    {
+        // Four lanes with no dependency on each other, one 32-byte stripe per step
+        uint64_t lane1 = seed + Prime1 + Prime2;
+        uint64_t lane2 = seed + Prime2;
+        uint64_t lane3 = seed;
+        uint64_t lane4 = seed - Prime1;
+
+        const unsigned char* limit = end - 32;
+        do
+        {
+            lane1 = Round(lane1, Read64(bytes));
+            lane2 = Round(lane2, Read64(bytes + 8));
+            lane3 = Round(lane3, Read64(bytes + 16));
+            lane4 = Round(lane4, Read64(bytes + 24));
+            bytes += 32;
+        } while (bytes <= limit);
+
+        hash = RotateLeft(lane1, 1) + RotateLeft(lane2, 7) + RotateLeft(lane3, 12) + RotateLeft(lane4, 18);
+        hash = MergeRound(hash, lane1);
+        hash = MergeRound(hash, lane2);
+        hash = MergeRound(hash, lane3);
+        hash = MergeRound(hash, lane4);
+    }
+    else
+    {
+        hash = seed + Prime5;
+    }
+
+    hash += static_cast<uint64_t>(size);
+
+    // Tail shorter than a stripe
+    for (; bytes + 8 <= end; bytes += 8)
+    {
+        hash ^= Round(0, Read64(bytes));
+        hash = RotateLeft(hash, 27) * Prime1 + Prime4;
+    }
+    if (bytes + 4 <= end)
+    {
+        hash ^= static_cast<uint64_t>(Read32(bytes)) * Prime1;
+        hash = RotateLeft(hash, 23) * Prime2 + Prime3;
+        bytes += 4;
+    }
+    for (; bytes < end; ++bytes)
+    {
+        hash ^= (*bytes) * Prime5;
+        hash = RotateLeft(hash, 11) * Prime1;
+    }
+
+    // Avalanche
+    hash ^= hash >> 33;
+    hash *= Prime2;
+    hash ^= hash >> 29;
+    hash *= Prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+size_t ChunkStore::GetBlobCount() const
+{
+    // Entries leave the index when their blob is freed, so every one still there is alive or about to go
+    size_t count = 0;
+    for (Shard& shard : *shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        count += shard.blobs.size();
+    }
+    return count;
+}
+
+size_t ChunkStore::GetStoredBytes() const
+{
+    return *storedBytes;
+}
+
+size_t ChunkStore::GetDedupHits() const
+{
+    return dedupHits;
+}
+
+void ChunkStore::SetAllocator(std::shared_ptr<ChunkAllocator> allocator)
+{
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+    this->allocator = allocator ? allocator : heapAllocator;
+}
+
+std::shared_ptr<ChunkAllocator> ChunkStore::GetAllocator() const
+{
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+    return allocator;
+}
+
+size_t ChunkStore::GetAllocatorFallbacks() const
+{
+    return allocatorFallbacks;
+}
@@ -0,0 +1,157 @@
+#include "Crc32c.h"
+#include <cstring>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define CRC32C_X86 1
+#include <intrin.h>
+#include <nmmintrin.h>
+#define CRC32C_SSE42_TARGET
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32C_X86 1
+#include <nmmintrin.h>
+#define CRC32C_SSE42_TARGET __attribute__((target("sse4.2")))
+#elif defined(__ARM_FEATURE_CRC32)
+#define CRC32C_ARM 1
+#include <arm_acle.h>
+#endif
+
+namespace
+{
+    const uint32_t Polynomial = 0x82F63B78;  // Reflected Castagnoli polynomial
+
+    // Slicing-by-8 tables, Tables[k][b] is the CRC of byte b followed by k zero bytes
+    struct Tables
+    {
+        uint32_t entries[8][256];
+
+        Tables()
+        {
+            for (uint32_t b = 0; b < 256; ++b)
+            {
+                uint32_t crc = b;
+                for (int bit = 0; bit < 8; ++bit)
+                {
+                    crc = (crc >> 1) ^ (Polynomial & (0u - (crc & 1)));
+                }
+                entries[0][b] = crc;
+            }
+            for (uint32_t b = 0; b < 256; ++b)
+            {
+                for (int k = 1; k < 8; ++k)
+                {
+                    entries[k][b] = (entries[k - 1][b] >> 8) ^ entries[0][entries[k - 1][b] & 0xFF];
+                }
+            }
+        }
+    };
+
+    uint32_t ComputeTable(const unsigned char* bytes, size_t size, uint32_t crc)
+    {
+        static const Tables tables;
+        const uint32_t (*t)[256] = tables.entries;
+
+        for (; size >= 8; size -= 8, bytes += 8)
+        {
+            uint32_t low;
+            uint32_t high;
+            memcpy(&low, bytes, sizeof(low));
+            memcpy(&high, bytes + 4, sizeof(high));
+            low ^= crc;
+            crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+                t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+        }
+        for (; size > 0; --size, ++bytes)
+        {
+            crc = (crc >> 8) ^ t[0][(crc ^ *bytes) & 0xFF];
+        }
+        return crc;
+    }
+
+#if defined(CRC32C_X86)
+    CRC32C_SSE42_TARGET uint32_t ComputeHardware(const unsigned char* bytes, size_t size, uint32_t crc)
+    {
+#if defined(_M_X64) || defined(__x86_64__)
+        uint64_t crc64 = crc;
+        for (; size >= 8; size -= 8, bytes += 8)
+        {
+            uint64_t word;
+            memcpy(&word, bytes, sizeof(word));
+            crc64 = _mm_crc32_u64(crc64, word);
+        }
+        crc = static_cast<uint32_t>(crc64);
+#endif
+        for (; size >= 4; size -= 4, bytes += 4)
+        {
+            uint32_t word;
+            memcpy(&word, bytes, sizeof(word));
+            crc = _mm_crc32_u32(crc, word);
+        }
+        for (; size > 0; --size, ++bytes)
+        {
+            crc = _mm_crc32_u8(crc, *bytes);
+        }
+        return crc;
+    }
+
+    bool DetectHardware()
+    {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 20)) != 0;
+#else
+        return __builtin_cpu_supports("sse4.2") != 0;
+#endif
+    }
+#elif defined(CRC32C_ARM)
+    uint32_t ComputeHardware(const unsigned char* bytes, size_t size, uint32_t crc)
+    {
+        for (; size >= 8; size -= 8, bytes += 8)
+        {
+            uint64_t word;
+            memcpy(&word, bytes, sizeof(word));
+            crc = __crc32cd(crc, word);
+        }
+        for (; size > 0; --size, ++bytes)
+        {
+            crc = __crc32cb(crc, *bytes);
+        }
+        return crc;
+    }
+
+    bool DetectHardware()
+    {
+        return true;
+    }
+#else
+    uint32_t ComputeHardware(const unsigned char* bytes, size_t size, uint32_t crc)
+    {
+        return ComputeTable(bytes, size, crc);
+    }
+
+    bool DetectHardware()
+    {
+        return false;
+    }
+#endif
+
+    // Checked once, the answer cannot change while the process runs
+    bool HasHardware()
+    {
+        static const bool hasHardware = DetectHardware();
+        return hasHardware;
+    }
+}
+
+uint32_t Crc32c::Compute(const void* data, size_t size, uint32_t crc)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    crc = HasHardware() ? ComputeHardware(bytes, size, crc) : ComputeTable(bytes, size, crc);
+    return ~crc;
+}
+
+bool Crc32c::IsHardwareAccelerated()
+{
+    return HasHardware();
+}
@@ -0,0 +1,51 @@
+#include "DirtyRangeSet.h"
+#include <algorithm>
+
+void DirtyRangeSet::Add(size_t begin, size_t end)
+{
+    if (begin >= end)
+    {
+        return;
+    }
+
+    // First range that ends at or after the new one begins, everything before it stays untouched
+    auto first = std::lower_bound(ranges.begin(), ranges.end(), begin,
+        [](const Range& range, size_t value) { return range.end < value; });
+
+    // Swallow every range that overlaps or touches the new one
+    auto last = first;
+    while (last != ranges.end() && last->begin <= end)
+    {
+        begin = std::min(begin, last->begin);
+        end = std::max(end, last->end);
+        ++last;
+    }
+
+    first = ranges.erase(first, last);
+    ranges.insert(first, Range{ begin, end });
+}
+
+void DirtyRangeSet::Clear()
+{
+    ranges.clear();
+}
+
+bool DirtyRangeSet::IsEmpty() const
+{
+    return ranges.empty();
+}
+
+const std::vector<DirtyRangeSet::Range>& DirtyRangeSet::GetRanges() const
+{
+    return ranges;
+}
+
+size_t DirtyRangeSet::GetByteCount() const
+{
+    size_t byteCount = 0;
+    for (const Range& range : ranges)
+    {
+        byteCount += range.end - range.begin;
+    }
+    return byteCount;
+}
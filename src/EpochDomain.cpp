@@ -0,0 +1,97 @@
+#include "EpochDomain.h"
+#include <thread>
+
+EpochDomain::Guard::Guard(Guard&& other) : domain(other.domain), slot(other.slot)
+{
+    other.domain = nullptr;
+}
+
+EpochDomain::Guard::~Guard()
+{
+    if (domain)
+    {
+        // Release, so the reader's loads of shared objects are done before the writer sees the slot free
+        domain->slots[slot].epoch.store(0, std::memory_order_release);
+    }
+}
+
+EpochDomain::EpochDomain() : epoch(1)
+{
+    for (auto& slot : slots)
+    {
+        slot.epoch.store(0, std::memory_order_relaxed);
+    }
+}
+
+EpochDomain::~EpochDomain()
+{
+    for (auto& entry : retired)
+    {
+        entry.reclaim();
+    }
+}
+
+EpochDomain::Guard EpochDomain::Pin()
+{
+    // Start at a slot picked by the thread so concurrent readers rarely try the same one
+    size_t slot = std::hash<std::thread::id>()(std::this_thread::get_id()) % SlotCount;
+    for (;;)
+    {
+        // An epoch that went stale before the slot is claimed only keeps objects alive longer
+        uint64_t current = epoch.load();
+        for (size_t attempt = 0; attempt < SlotCount; ++attempt, slot = (slot + 1) % SlotCount)
+        {
+            uint64_t expected = 0;
+            if (slots[slot].epoch.load(std::memory_order_relaxed) == 0 && slots[slot].epoch.compare_exchange_strong(expected, current))
+            {
+                return Guard(this, slot);
+            }
+        }
+
+        // Every slot is taken, wait for a reader to finish
+        std::this_thread::yield();
+    }
+}
+
+void EpochDomain::Retire(std::function<void()> reclaim)
+{
+    // Readers that pin from here on get a later epoch and load the replacement
+    Retired entry;
+    entry.epoch = epoch.fetch_add(1);
+    entry.reclaim = std::move(reclaim);
+    retired.push_back(std::move(entry));
+    Reclaim();
+}
+
+size_t EpochDomain::Reclaim()
+{
+    uint64_t oldestPinned = UINT64_MAX;
+    for (auto& slot : slots)
+    {
+        uint64_t pinned = slot.epoch.load();
+        if (pinned != 0 && pinned < oldestPinned)
+        {
+            oldestPinned = pinned;
+        }
+    }
+
+    // A reader pinned at epoch e may hold objects retired at e or later
+    size_t kept = 0;
+    for (size_t i = 0; i < retired.size(); ++i)
+    {
+        if (retired[i].epoch < oldestPinned)
+        {
+            retired[i].reclaim();
+        }
+        else
+        {
+            if (kept != i)
+            {
+                retired[kept] = std::move(retired[i]);
+            }
+            ++kept;
+        }
+    }
+    retired.resize(kept);
+    return kept;
+}
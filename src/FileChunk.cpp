@@ -1,12 +1,20 @@
 #include "FileChunk.h"
 
 
-FileChunk::FileChunk() : data(nullptr), size(0) {}
+FileChunk::FileChunk() : data(nullptr), size(0), readOnly(false) {}
 
 void FileChunk::LoadData(void* chunkData, size_t chunkSize)
 {
     data = chunkData;
     size = chunkSize;
+    readOnly = false;
+}
+
+void FileChunk::LoadView(const void* chunkData, size_t chunkSize)
+{
+    data = const_cast<void*>(chunkData);
+    size = chunkSize;
+    readOnly = true;
 }
 
 void* FileChunk::GetData()
@@ -18,3 +26,8 @@ size_t FileChunk::GetSize()
 {
     return size;
 }
+
+bool FileChunk::IsReadOnly() const
+{
+    return readOnly;
+}
@@ -0,0 +1,309 @@
+#include "ImageViewer.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cstring>
+#include <future>
+
+namespace
+{
+    // Window size before the first image decides it
+    const int DefaultWidth = 800;
+    const int DefaultHeight = 600;
+}
+
+ImageViewer::ImageViewer()
+    : wakeEvent(static_cast<Uint32>(-1)), running(false), stopping(false), visible(false), showRequested(false), frameCount(0), pending(nullptr), postedSize(0)
+{
+}
+
+ImageViewer::~ImageViewer()
+{
+    Stop();
+}
+
+bool ImageViewer::Start(const std::string& windowTitle)
+{
+    if (running.load(std::memory_order_acquire))
+    {
+        return true;
+    }
+
+    // The thread of an earlier run can have ended on its own when SDL failed
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+
+    this->windowTitle = windowTitle;
+    stopping.store(false, std::memory_order_relaxed);
+    postedSize = 0;
+
+    std::promise<bool> started;
+    std::future<bool> result = started.get_future();
+    thread = std::thread([this, &started]()
+    {
+        // SDL is initialized on the thread that handles its events and owns its window
+        bool ready = sdlManager.InitLibraries();
+        if (ready)
+        {
+            wakeEvent = SDL_RegisterEvents(1);
+            ready = wakeEvent != static_cast<Uint32>(-1);
+            if (!ready)
+            {
+                LOG_ERROR("SDL_RegisterEvents Error: " << SDL_GetError());
+                sdlManager.Cleanup();
+            }
+        }
+        running.store(ready, std::memory_order_release);
+        started.set_value(ready);
+        if (ready)
+        {
+            Run();
+        }
+    });
+
+    if (!result.get())
+    {
+        thread.join();
+        return false;
+    }
+    return true;
+}
+
+void ImageViewer::Stop()
+{
+    if (!thread.joinable())
+    {
+        return;
+    }
+
+    stopping.store(true, std::memory_order_release);
+    if (IsRunning())
+    {
+        Wake();
+    }
+    thread.join();
+    running.store(false, std::memory_order_release);
+    visible.store(false, std::memory_order_release);
+}
+
+bool ImageViewer::IsRunning() const
+{
+    return running.load(std::memory_order_acquire);
+}
+
+void ImageViewer::UpdateImage(const void* imageData, size_t imageSize, const DirtyRangeSet& changes)
+{
+    if (!IsRunning())
+    {
+        return;
+    }
+
+    // The viewer's copy has another size or no image at all, so it gets the whole image
+    bool replace = imageSize != postedSize;
+    if (!replace && changes.IsEmpty())
+    {
+        return;
+    }
+
+    Frame* frame = new Frame;
+    frame->replace = replace;
+    frame->imageSize = imageSize;
+    if (!replace)
+    {
+        for (const auto& range : changes.GetRanges())
+        {
+            if (range.begin < imageSize)
+            {
+                frame->changes.Add(range.begin, std::min(range.end, imageSize));
+            }
+        }
+    }
+    Post(frame, imageData);
+    postedSize = imageSize;
+}
+
+void ImageViewer::ShowFile(const std::string& imagePath)
+{
+    if (!IsRunning())
+    {
+        return;
+    }
+
+    Frame* frame = new Frame;
+    frame->imagePath = imagePath;
+    Post(frame, nullptr);
+    postedSize = 0;
+}
+
+void ImageViewer::Show()
+{
+    if (!IsRunning())
+    {
+        return;
+    }
+
+    showRequested.store(true, std::memory_order_release);
+    Wake();
+}
+
+bool ImageViewer::IsVisible() const
+{
+    return visible.load(std::memory_order_acquire);
+}
+
+uint64_t ImageViewer::GetFrameCount() const
+{
+    return frameCount.load(std::memory_order_relaxed);
+}
+
+void ImageViewer::Post(Frame* frame, const void* imageData)
+{
+    // Take back a frame the viewer thread has not picked up yet, its bytes never reached the viewer's copy
+    Frame* previous = pending.exchange(nullptr, std::memory_order_acq_rel);
+    if (previous && imageData && !frame->replace)
+    {
+        if (previous->replace)
+        {
+            frame->replace = true;
+            frame->changes.Clear();
+        }
+        else
+        {
+            // The current image holds the newest bytes of both frames' ranges
+            for (const auto& range : previous->changes.GetRanges())
+            {
+                frame->changes.Add(range.begin, range.end);
+            }
+        }
+    }
+    delete previous;
+
+    // Copy now, the caller goes on changing its image once this returns
+    const char* source = static_cast<const char*>(imageData);
+    if (frame->replace)
+    {
+        frame->bytes.assign(source, source + frame->imageSize);
+    }
+    else if (source)
+    {
+        frame->bytes.reserve(frame->changes.GetByteCount());
+        for (const auto& range : frame->changes.GetRanges())
+        {
+            frame->bytes.insert(frame->bytes.end(), source + range.begin, source + range.end);
+        }
+    }
+
+    pending.store(frame, std::memory_order_release);
+    Wake();
+}
+
+void ImageViewer::Wake()
+{
+    SDL_Event event;
+    SDL_zero(event);
+    event.type = wakeEvent;
+    if (SDL_PushEvent(&event) < 0)
+    {
+        LOG_ERROR("SDL_PushEvent Error: " << SDL_GetError());
+    }
+}
+
+void ImageViewer::Run()
+{
+    bool redraw = false;
+    SDL_Event event;
+
+    // Sleeps until SDL has an event, a frame or a Show wakes it with wakeEvent
+    while (!stopping.load(std::memory_order_acquire) && SDL_WaitEvent(&event))
+    {
+        // Handle everything queued, then draw at most once
+        do
+        {
+            if (event.type == wakeEvent)
+            {
+                redraw = ApplyPending() || redraw;
+            }
+            else if (event.type == SDL_QUIT || (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_x) ||
+                (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_CLOSE))
+            {
+                // The window and texture stay alive for the next Show
+                sdlManager.Hide();
+                visible.store(false, std::memory_order_release);
+            }
+            else if (event.type == SDL_WINDOWEVENT && (event.window.event == SDL_WINDOWEVENT_EXPOSED ||
+                event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED || event.window.event == SDL_WINDOWEVENT_SHOWN))
+            {
+                redraw = true;
+            }
+        } while (SDL_PollEvent(&event));
+
+        if (redraw && visible.load(std::memory_order_acquire) && sdlManager.IsInitialized())
+        {
+            sdlManager.Render();
+            frameCount.fetch_add(1, std::memory_order_relaxed);
+            redraw = false;
+        }
+    }
+
+    delete pending.exchange(nullptr, std::memory_order_acquire);
+    image.clear();
+    sdlManager.Cleanup();
+    visible.store(false, std::memory_order_release);
+    running.store(false, std::memory_order_release);
+}
+
+bool ImageViewer::ApplyPending()
+{
+    bool changed = false;
+    Frame* frame = pending.exchange(nullptr, std::memory_order_acquire);
+    if (frame)
+    {
+        bool ready;
+        if (!frame->imagePath.empty())
+        {
+            image.clear();
+            ready = sdlManager.Init(windowTitle, DefaultWidth, DefaultHeight, frame->imagePath);
+        }
+        else if (frame->replace)
+        {
+            image.swap(frame->bytes);
+            ready = sdlManager.Init(windowTitle, DefaultWidth, DefaultHeight, image.data(), image.size());
+        }
+        else if (image.size() != frame->imageSize)
+        {
+            LOG_ERROR("The image viewer got changes for an image it does not have.");
+            ready = false;
+        }
+        else
+        {
+            const char* source = frame->bytes.data();
+            for (const auto& range : frame->changes.GetRanges())
+            {
+                memcpy(image.data() + range.begin, source, range.end - range.begin);
+                source += range.end - range.begin;
+            }
+
+            // A texture that cannot be patched (decoded image, changed header) is built again from the copy
+            ready = sdlManager.UpdateImage(image.data(), image.size(), frame->changes) ||
+                sdlManager.Init(windowTitle, DefaultWidth, DefaultHeight, image.data(), image.size());
+        }
+        delete frame;
+
+        if (!ready)
+        {
+            LOG_ERROR("The image viewer cannot show the image.");
+            sdlManager.Hide();
+            visible.store(false, std::memory_order_release);
+        }
+        changed = true;
+    }
+
+    if (showRequested.exchange(false, std::memory_order_acq_rel) && sdlManager.IsInitialized())
+    {
+        sdlManager.Show();
+        visible.store(true, std::memory_order_release);
+        changed = true;
+    }
+    return changed;
+}
@@ -1,28 +1,58 @@
 #include "Asset.h"
 #include "Level.h"
 #include "FileChunk.h"
+#include "AsyncIO.h"
+#include "ChunkStore.h"
+#include "ChunkCatalog.h"
+#include "BlockCodec.h"
+#include "Crc32c.h"
+#include "Logger.h"
+#include "WorkerPool.h"
 #include <fstream>
 #include <iostream>
 #include <cstring> // memcpy
+#include <cstdio>  // rename, remove
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
 
-Level::Level(size_t totalSize) : imageBuffer(nullptr), totalSize(totalSize), currentOffset(0)
+// Chunk payloads in allocator memory are cache-line aligned for SIMD access
+static const size_t ChunkDataAlignment = 64;
+
+// Image that chunk edits are saved to
+static const char* const DefaultImagePath = "NewImage.tga";
+
+// Prefetching looks this many windows ahead at most, so a run over chunks already in memory stays linear
+static const size_t PrefetchScanWindows = 4;
+
+Level::Level(size_t totalSize) : imageBuffer(nullptr), totalSize(totalSize)
 {
-    // Initialize chunk status to false (none loaded yet)
-    chunkStatus.resize(7, false);  // Assuming 7 chunks
+    // The chunk count comes from the manifest, see SetChunkManifest
 }
 
 Level::~Level()
 {
     // Ensure resources are cleaned up
-    DeleteImageBuffer();
+    if (imageBuffer != nullptr)
+    {
+        DeleteImageBuffer();
+    }
+
+    // Tables retired earlier go with tableEpochs, no reader may outlive the level
+    delete publishedTable.load();
 }
 
 // Creates image buffer
 void Level::CreateImageBuffer(size_t totalSize)
 {
+    TableUpdate update(*this);
     if (imageBuffer != nullptr)
     {
-        std::cerr << "Image buffer already exists!" << std::endl;
+        LOG_WARNING("Image buffer already exists!");
         return;
     }
 
@@ -30,348 +60,2034 @@ void Level::CreateImageBuffer(size_t totalSize)
     imageBuffer = malloc(totalSize);
     if (imageBuffer == nullptr)
     {
-        std::cerr << "Failed to allocate memory for image buffer!" << std::endl;
+        LOG_ERROR("Failed to allocate memory for image buffer!");
         return;
     }
 
     // Initialize the buffer to zeros
     memset(imageBuffer, 0, totalSize);
     this->totalSize = totalSize;
+
+    // The new buffer no longer matches any saved image, nor what the viewer shows
+    savedImagePath.clear();
+    dirtyRanges.Clear();
+    imageChanges.Clear();
+    imageChanges.Add(0, totalSize);
     
     // unit test : image buffer size autoscaling adjusting
-    //std::cout << "Image buffer created with size: " << totalSize << " bytes." << std::endl;
+    LOG_DEBUG("Image buffer created with size: " << totalSize << " bytes.");
 }
 
 // Deletes image buffer and resets state
 void Level::DeleteImageBuffer()
 {
+    TableUpdate update(*this);
     if (imageBuffer == nullptr)
     {
-        std::cerr << "No image buffer to delete!" << std::endl;
+        LOG_WARNING("No image buffer to delete!");
         return;
     }
 
-    // Deallocate memory and reset metadata
+    // Deallocate memory and reset metadata, the undo history refers to the old buffer
+    journal.Clear();
     free(imageBuffer);
     imageBuffer = nullptr;
     totalSize = 0;
-    currentOffset = 0;
+    savedImagePath.clear();
+    dirtyRanges.Clear();
+    imageChanges.Clear();
 
     // Reset chunk status
     chunkStatus.assign(chunkStatus.size(), false);
 
-    std::cout << "Image buffer deleted." << std::endl;
+    LOG_INFO("Image buffer deleted.");
 }
 
 // Assembles chunks into the image buffer
 bool Level::AssembleChunks(const std::vector<std::string>& chunkFiles, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool, const std::string& outputImagePath, ObjectPool<Asset>& assetPool)
 {
+    TableUpdate update(*this);
+    ScopedLatency assemblyTime(stats.assembly);
     if (imageBuffer == nullptr)
     {
-        std::cerr << "Image buffer is not created!" << std::endl;
+        LOG_ERROR("Image buffer is not created!");
         return false;
     }
 
+    // Lay out the chunk slots unless these chunk files are already the manifest
+    if (chunkFiles != this->chunkFiles)
+    {
+        SetChunkManifest(chunkFiles, fileChunkPool);
+    }
+
+    // Chunks are added in order, so the first one already starts the read-ahead
+    lastAccessIndex = -1;
+
     // Iterate through chunk files then add to image buffer
     for (size_t i = 0; i < chunkFiles.size(); ++i)
     {
-        if (!AddChunk(static_cast<int>(i), chunkFiles[i], allocator, fileChunkPool, assetPool, undoStack))  // Explicit cast to int))
+        if (!AddChunk(static_cast<int>(i), chunkFiles[i], allocator, fileChunkPool, assetPool))  // Explicit cast to int))
         {
-            std::cerr << "Failed to add chunk: " << i << std::endl;
+            LOG_ERROR("Failed to add chunk: " << i);
             return false;
         }
     }
 
     // After all chunks are processed
-    std::cout << "LEVEL" << std::endl;
-    std::cout << "BASE RESOURCE" << std::endl;
+    LOG_INFO("LEVEL");
+    LOG_INFO("BASE RESOURCE");
 
     // Save the assembled image
     return SaveImage(outputImagePath);
 }
 
-bool Level::AddChunk(int chunkIndex, const std::string& chunkFile, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool, ObjectPool<Asset>& assetPool, std::stack<std::string>& undoStack)
+// Assembles chunks into the image buffer with one batch of asynchronous reads
+bool Level::AssembleChunksParallel(const std::vector<std::string>& chunkFiles, ObjectPool<FileChunk>& fileChunkPool, const std::string& outputImagePath, unsigned int workerCount)
 {
-    if (chunkIndex < 0 || chunkIndex >= chunkStatus.size())
+    TableUpdate update(*this);
+    ScopedLatency assemblyTime(stats.assembly);
+    if (imageBuffer == nullptr)
     {
-        std::cerr << "Invalid chunk index!" << std::endl;
+        LOG_ERROR("Image buffer is not created!");
         return false;
     }
 
-    // If the chunk is loaded, skip
-    if (chunkStatus[chunkIndex])
-    {    // unit test - reusing object pools
-        //std::cerr << "Chunk " << chunkIndex << " already added!" << std::endl;
-        return true;
+    // The manifest prefix-sums the chunk sizes into fixed destination offsets
+    SetChunkManifest(chunkFiles, fileChunkPool);
+
+    if (GetRequiredImageSize() > totalSize)
+    {
+        LOG_ERROR("Image buffer is too small for the chunks!");
+        return false;
     }
 
-    // Acquire a new FileChunk object from the pool before logging the asset allocation
-    FileChunk* chunk = fileChunkPool.Acquire();
+    // One batched read per chunk, each lands straight in its slot and slots never overlap
+    std::vector<IORequest> reads;
+    reads.reserve(chunkFiles.size());
+    for (size_t i = 0; i < chunkFiles.size(); ++i)
+    {
+        reads.push_back(IORequest::Read(chunkFiles[i], static_cast<char*>(imageBuffer) + chunkOffsets[i], chunkSizes[i], 0));
+    }
+
+    std::unique_ptr<AsyncIO> dedicatedIO(workerCount > 0 ? new AsyncIO(workerCount) : nullptr);
+    AsyncIO& io = dedicatedIO ? *dedicatedIO : AsyncIO::Default();
+    if (!io.Execute(reads))
+    {
+        for (const auto& read : reads)
+        {
+            if (!read.Succeeded())
+            {
+                LOG_ERROR("Failed to read chunk file: " << read.path);
+            }
+        }
+        return false;
+    }
+    stats.bytesRead += GetRequiredImageSize();
 
-    // Acquire a new Asset object from the pool before logging the asset allocation
-    Asset* asset = assetPool.Acquire();
+    // Bookkeeping stays on this thread, the object pool is not thread-safe
+    for (size_t i = 0; i < chunkFiles.size(); ++i)
+    {
+        FileChunk* chunk = fileChunkPool.Acquire();
+        if (!chunk)
+        {
+            LOG_ERROR("FileChunk pool is exhausted!");
+            return false;
+        }
+        chunk->LoadData(static_cast<char*>(imageBuffer) + chunkOffsets[i], chunkSizes[i]);
+        chunkBlobs[i].reset();
+        chunkPointers[i] = chunk;
+        chunkStatus[i] = true;
+        ++stats.chunksAdded;
+    }
+    imageChanges.Add(0, GetRequiredImageSize());
 
+    // Save the assembled image
+    return SaveImage(outputImagePath);
+}
 
-    // Log the asset to UI
-    std::cout << "Allocating asset " << chunkFile << std::endl;
+// Pipes every chunk file into the output image through a fixed ring of buffers, no image buffer is needed
+bool Level::AssembleChunksStreaming(const std::vector<std::string>& chunkFiles, ObjectPool<FileChunk>& fileChunkPool, const std::string& outputImagePath, size_t bufferSize, size_t bufferCount)
+{
+    TableUpdate update(*this);
+    ScopedLatency assemblyTime(stats.assembly);
+    SetChunkManifest(chunkFiles, fileChunkPool);
 
-    // Load the chunk and allocate memory
-    std::ifstream inputChunk(chunkFile, std::ios::binary);
-    if (!inputChunk)
+    std::ofstream outputImage(outputImagePath, std::ios::binary | std::ios::trunc);
+    if (!outputImage)
     {
-        std::cerr << "Failed to open chunk file: " << chunkFile << std::endl;
+        LOG_ERROR("Failed to save image to: " << outputImagePath);
         return false;
     }
 
-    inputChunk.seekg(0, std::ios::end);
-    size_t chunkSize = inputChunk.tellg();
-    inputChunk.seekg(0, std::ios::beg);
-
-    void* chunkData = allocator.Allocate(chunkSize);
-    if (!chunkData)
+    // The image file is rewritten behind the buffer's back
+    if (outputImagePath == savedImagePath)
     {
-        std::cerr << "Failed to allocate memory for chunk " << chunkIndex << std::endl;
-        return false;
+        savedImagePath.clear();
     }
 
-    inputChunk.read(static_cast<char*>(chunkData), chunkSize);
+    bufferSize = std::max<size_t>(bufferSize, 1);
+    bufferCount = std::max<size_t>(bufferCount, 2);
+    std::unique_ptr<char[]> ring(new char[bufferSize * bufferCount]);
+    std::vector<size_t> filled(bufferCount, 0);
+
+    // The reader fills buffers in ring order, this thread drains them in the same order
+    std::mutex ringMutex;
+    std::condition_variable bufferReady;
+    std::condition_variable bufferFree;
+    size_t produced = 0;
+    size_t consumed = 0;
+    bool readerDone = false;
+    bool writerFailed = false;
+    size_t failedChunk = chunkFiles.size();
+
+    std::thread reader([&]()
+    {
+        for (size_t i = 0; i < chunkFiles.size() && failedChunk == chunkFiles.size(); ++i)
+        {
+            std::ifstream inputChunk(chunkFiles[i], std::ios::binary);
+            size_t remaining = chunkSizes[i];
+            while (inputChunk && remaining > 0)
+            {
+                size_t slot;
+                {
+                    std::unique_lock<std::mutex> lock(ringMutex);
+                    bufferFree.wait(lock, [&]() { return produced - consumed < bufferCount || writerFailed; });
+                    if (writerFailed)
+                    {
+                        break;
+                    }
+                    slot = produced % bufferCount;
+                }
 
+                // Reading happens outside the lock, the writer never touches a slot it has not been handed
+                inputChunk.read(ring.get() + slot * bufferSize, std::min(remaining, bufferSize));
+                size_t bytesRead = static_cast<size_t>(inputChunk.gcount());
+                remaining -= bytesRead;
+                stats.bytesRead += bytesRead;
 
-    // Load data into the FileChunk object
-    chunk->LoadData(chunkData, chunkSize);
+                std::lock_guard<std::mutex> lock(ringMutex);
+                filled[slot] = bytesRead;
+                ++produced;
+                bufferReady.notify_one();
+            }
 
-    // Release the asset back to pool
-    assetPool.Release(asset);
+            // A chunk file that is missing or shorter than its manifest size would shift every later chunk
+            if (!inputChunk.is_open() || remaining > 0)
+            {
+                std::lock_guard<std::mutex> lock(ringMutex);
+                failedChunk = i;
+            }
+        }
 
-    // Copy the chunk data into the image buffer at the current offset
-    memcpy(static_cast<char*>(imageBuffer) + currentOffset, chunkData, chunkSize);
-    currentOffset += chunkSize;
+        std::lock_guard<std::mutex> lock(ringMutex);
+        readerDone = true;
+        bufferReady.notify_one();
+    });
 
-    // Update chunk status
-    chunkStatus[chunkIndex] = true;
+    for (;;)
+    {
+        size_t slot;
+        {
+            std::unique_lock<std::mutex> lock(ringMutex);
+            bufferReady.wait(lock, [&]() { return produced > consumed || readerDone; });
+            if (produced == consumed)
+            {
+                break;
+            }
+            slot = consumed % bufferCount;
+        }
+
+        outputImage.write(ring.get() + slot * bufferSize, filled[slot]);
+        stats.bytesWritten += filled[slot];
+
+        std::lock_guard<std::mutex> lock(ringMutex);
+        ++consumed;
+        if (!outputImage)
+        {
+            writerFailed = true;
+        }
+        bufferFree.notify_one();
+        if (writerFailed)
+        {
+            break;
+        }
+    }
 
-    // Add the action to the undo stack for undo functionality
-    undoStack.push("AddChunk " + std::to_string(chunkIndex));
+    reader.join();
+    outputImage.close();
 
+    if (writerFailed || !outputImage)
+    {
+        LOG_ERROR("Failed to save image to: " << outputImagePath);
+        return false;
+    }
+    if (failedChunk < chunkFiles.size())
+    {
+        LOG_ERROR("Failed to read chunk file: " << chunkFiles[failedChunk]);
+        return false;
+    }
     return true;
 }
 
-// Removes chunk from the image buffer (zeros out the memory)
-void Level::RemoveChunk(int chunkIndex)
+bool Level::AddChunk(int chunkIndex, const std::string& chunkFile, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool, ObjectPool<Asset>& assetPool)
 {
-    if (chunkIndex < 0 || chunkIndex >= chunkStatus.size() || !chunkStatus[chunkIndex])
+    TableUpdate update(*this, chunkIndex);
+    if (chunkIndex < 0 || chunkIndex >= chunkStatus.size())
     {
-        std::cerr << "Invalid or non-existent chunk to remove!" << std::endl;
-        return;
+        LOG_ERROR("Invalid chunk index!");
+        return false;
     }
 
-    // Get chunk start position and size
-    void* chunkStart = GetChunkStart(chunkIndex);
-    size_t chunkSize = GetChunkSize(chunkIndex);
-    if (!chunkStart || chunkSize == 0)  // unit test
+    // If the chunk is loaded, skip
+    if (chunkStatus[chunkIndex])
+    {    // unit test - reusing object pools
+        LOG_DEBUG("Chunk " << chunkIndex << " already added!");
+        return true;
+    }
+
+    if (imageBuffer == nullptr || chunkOffsets[chunkIndex] + chunkSizes[chunkIndex] > totalSize)
     {
-        std::cerr << "Failed to retrieve chunk memory or size for chunk " << chunkIndex << "." << std::endl;
-        return;
+        LOG_ERROR("Image buffer is not created or too small for chunk " << chunkIndex);
+        return false;
     }
 
+    // Reuse the chunk's FileChunk if it had one, otherwise acquire a new one that goes back to the pool on failure
+    ObjectPool<FileChunk>::Handle newChunk;
+    FileChunk* chunk = chunkPointers[chunkIndex];
+    if (!chunk)
+    {
+        newChunk = fileChunkPool.AcquireHandle();
+        chunk = newChunk.Get();
+    }
 
-    // Zero out the chunk memory
-    memset(chunkStart, 0, chunkSize);
+    // Acquire a new Asset object from the pool before logging the asset allocation, it returns to the pool on scope exit
+    ObjectPool<Asset>::Handle asset = assetPool.AcquireHandle();
+    if (!chunk || !asset)
+    {
+        LOG_ERROR("Object pool is exhausted!");
+        return false;
+    }
 
-    // Update the chunk status
-    chunkStatus[chunkIndex] = false;
-    undoStack.push("RemoveChunk " + std::to_string(chunkIndex));
-    std::cout << "Chunk " << chunkIndex << " removed." << std::endl;
-    SaveImage("NewImage.tga");
-}
 
-// Gets starting address of a chunk
-std::string Level::GetChunkFile(int chunkIndex)
-{
-    // Assuming you have a vector `chunkFiles` in your class that stores the file paths of chunks
-    if (chunkIndex >= 0 && chunkIndex < chunkFiles.size())
+    // Log the asset to UI
+    LOG_DEBUG("Allocating asset " << chunkFile);
+
+    size_t chunkSize = 0;
+    if (ingestMode == ChunkIngestMode::Mapped)
     {
-        return chunkFiles[chunkIndex];  // Returns the file corresponding to the chunk index
+        // Map the chunk file, the FileChunk becomes a read-only view over the mapping
+        std::shared_ptr<MappedFile> mapping = std::make_shared<MappedFile>();
+        ScopedLatency openTime(stats.chunkOpen);
+        bool mapped = mapping->Open(chunkFile);
+        openTime.Stop();
+        if (!mapped)
+        {
+            LOG_ERROR("Failed to map chunk file: " << chunkFile);
+            return false;
+        }
+
+        chunkSize = mapping->GetSize();
+        if (chunkSize != chunkSizes[chunkIndex])
+        {
+            LOG_ERROR("Chunk file " << chunkFile << " no longer matches the manifest size.");
+            ChunkCatalog::Instance().Invalidate(chunkFile);
+            return false;
+        }
+
+        // The previous mapping goes away, undo history must not point into it
+        if (chunk->GetData())
+        {
+            journal.Detach(chunk->GetData());
+        }
+        chunk->LoadView(mapping->GetData(), chunkSize);
+        chunkBlobs[chunkIndex].reset();
+
+        if (chunkMappings.size() <= static_cast<size_t>(chunkIndex))
+        {
+            chunkMappings.resize(chunkIndex + 1);
+        }
+        chunkMappings[chunkIndex] = std::move(mapping);
     }
     else
     {
-        std::cerr << "Invalid chunk index!" << std::endl;
-        return "";
+        // The chunk store keeps the bytes, identical chunks share them
+        std::shared_ptr<const ChunkStore::Blob> blob = ReadChunkFile(chunkIndex, chunkFile);
+        if (!blob)
+        {
+            return false;
+        }
+        chunkSize = blob->GetSize();
+
+        // Load data into the FileChunk object, undo history keeps its own copy of the old data
+        if (chunk->GetData())
+        {
+            journal.Detach(chunk->GetData());
+        }
+        chunkBlobs[chunkIndex] = blob;
+        chunk->LoadView(blob->GetData(), chunkSize);
     }
-}
 
-// Saves current image buffer to output file
-bool Level::SaveImage(const std::string& outputImagePath)
-{
-    std::ofstream outputImage(outputImagePath, std::ios::binary);
-    if (!outputImage)
+    // Copy the chunk data into its slot in the image buffer, mapped pages are faulted in here
     {
-        std::cerr << "Failed to save image to: " << outputImagePath << std::endl;
-        return false;
+        ScopedLatency copyTime(stats.chunkCopy);
+        memcpy(static_cast<char*>(imageBuffer) + chunkOffsets[chunkIndex], chunk->GetData(), chunkSize);
     }
+    stats.bytesRead += chunkSize;
+    ++stats.chunksAdded;
+    MarkImageChanged(chunkOffsets[chunkIndex], chunkOffsets[chunkIndex] + chunkSize);
+
+    // The chunk no longer comes from the level file
+    if (static_cast<size_t>(chunkIndex) < levelTable.size())
+    {
+        levelTable[chunkIndex] = LevelChunkEntry();
+    }
+
+    // Update chunk status, the level keeps the FileChunk from here on
+    newChunk.Detach();
+    chunkPointers[chunkIndex] = chunk;
+    chunkStatus[chunkIndex] = true;
+    chunkFiles[chunkIndex] = chunkFile;
+
+    // Record the action in the journal for undo functionality
+    journal.Push(LevelCommandType::AddChunk, chunkIndex);
+
+    // The new payload is the most recently used, older ones make room for it
+    residency.Insert(chunkIndex, chunkSize);
+    EnforceResidencyBudget(fileChunkPool, chunkIndex);
+    PrefetchAfter(chunkIndex);
 
-    outputImage.write(static_cast<char*>(imageBuffer), totalSize);
-    // unit test - save to image filepath
-    // std::cout << "Image saved to " << outputImagePath << std::endl;
     return true;
 }
 
-// Calculate total size of chunk files
-size_t Level::CalculateTotalChunkSize(const std::vector<std::string>& chunkFiles)
+// Reads a whole chunk file straight into chunk store memory
+std::shared_ptr<const ChunkStore::Blob> Level::ReadChunkFile(int chunkIndex, const std::string& chunkFile)
 {
-    size_t totalSize = 0;
-    for (const auto& chunkFile : chunkFiles)
+    // Bytes the prefetcher read ahead skip the open and the read, a file changed since fails the size check
+    std::vector<char> staged;
+    if (prefetcher && prefetcher->Take(chunkFile, staged))
     {
-        std::ifstream inputChunk(chunkFile, std::ios::binary | std::ios::ate);
-        if (!inputChunk)
+        if (staged.size() == chunkSizes[chunkIndex])
         {
-            std::cerr << "Failed to open chunk file: " << chunkFile << std::endl;
-            continue;
+            return ChunkStore::Instance().Intern(staged.data(), staged.size());
         }
-        // Get the size of the file
-        size_t chunkSize = inputChunk.tellg();
-        totalSize += chunkSize;
+        LOG_ERROR("Chunk file " << chunkFile << " no longer matches the manifest size.");
+        ChunkCatalog::Instance().Invalidate(chunkFile);
+        return nullptr;
     }
-    return totalSize;
-}
 
-// Gets image buffer in main loop
-void* Level::GetImageBuffer() const
-{
-    return imageBuffer;
+    ScopedLatency openTime(stats.chunkOpen);
+    std::ifstream inputChunk(chunkFile, std::ios::binary);
+    openTime.Stop();
+    if (!inputChunk)
+    {
+        LOG_ERROR("Failed to open chunk file: " << chunkFile);
+        return nullptr;
+    }
+
+    inputChunk.seekg(0, std::ios::end);
+    size_t chunkSize = inputChunk.tellg();
+    inputChunk.seekg(0, std::ios::beg);
+    if (chunkSize != chunkSizes[chunkIndex])
+    {
+        LOG_ERROR("Chunk file " << chunkFile << " no longer matches the manifest size.");
+        ChunkCatalog::Instance().Invalidate(chunkFile);
+        return nullptr;
+    }
+
+    // The file is read into the blob's own memory, a duplicate of a live blob gives it back on commit
+    ChunkStore::PendingBlob pending = ChunkStore::Instance().Reserve(chunkSize);
+    if (!pending)
+    {
+        LOG_ERROR("Failed to allocate memory for chunk " << chunkIndex);
+        return nullptr;
+    }
+
+    ScopedLatency readTime(stats.chunkRead);
+    bool read = static_cast<bool>(inputChunk.read(static_cast<char*>(pending.GetData()), chunkSize));
+    readTime.Stop();
+    if (!read)
+    {
+        LOG_ERROR("Failed to read chunk file: " << chunkFile);
+        return nullptr;
+    }
+    return ChunkStore::Instance().Commit(std::move(pending));
 }
 
-bool Level::LoadLevel(const std::string& filename, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool, ObjectPool<Asset>& assetPool)
+// Evictable chunks can be read again, from the level file or the chunk file they were added from
+bool Level::CanEvictChunk(int chunkIndex, ObjectPool<FileChunk>& fileChunkPool) const
 {
-    std::ifstream file(filename, std::ios::binary);
-    if (!file)
+    FileChunk* chunk = chunkPointers[chunkIndex];
+    if (!chunk || !fileChunkPool.Owns(chunk))
     {
-        std::cerr << "Failed to open file: " << filename << " for reading." << std::endl;
         return false;
     }
 
-    // Clear current chunk data
-    chunkPointers.clear();
-    chunkStatus.assign(chunkStatus.size(), false);
-    currentOffset = 0;
+    bool inLevelFile = static_cast<size_t>(chunkIndex) < levelTable.size() && levelTable[chunkIndex].offset != 0 && !levelFileName.empty();
+    return inLevelFile || !chunkFiles[chunkIndex].empty();
+}
 
-    // Read chunk data from the file
-    while (!file.eof())
+// Lets go of a chunk's payload, the chunk stays in the level
+void Level::EvictChunk(int chunkIndex, ObjectPool<FileChunk>& fileChunkPool)
+{
+    TableUpdate update(*this, chunkIndex);
+
+    // A payload read back from its chunk file has to match what is let go here, the file may change meanwhile
+    FileChunk* chunk = chunkPointers[chunkIndex];
+    bool inLevelFile = static_cast<size_t>(chunkIndex) < levelTable.size() && levelTable[chunkIndex].offset != 0 && !levelFileName.empty();
+    if (!inLevelFile)
     {
-        size_t chunkSize = 0;
+        evictedChecksums[chunkIndex] = Crc32c::Compute(chunk->GetData(), chunk->GetSize());
+    }
 
-        // Read the size of the chunk
-        file.read(reinterpret_cast<char*>(&chunkSize), sizeof(chunkSize));
-        if (file.eof())
-            break;  // Stop if we've reached the end of the file
+    // Undo history that references the payload takes its own copy first
+    journal.Detach(chunk->GetData());
+    chunkBlobs[chunkIndex].reset();
+    if (static_cast<size_t>(chunkIndex) < chunkMappings.size())
+    {
+        chunkMappings[chunkIndex].reset();
+    }
+    fileChunkPool.Release(chunk);
+    chunkPointers[chunkIndex] = nullptr;
+    residency.Evict(chunkIndex);
+
+    LOG_DEBUG("Chunk " << chunkIndex << " evicted.");
+}
 
-        // Allocate memory for the chunk data
-        void* chunkData = allocator.Allocate(chunkSize);
-        if (!chunkData)
+void Level::EnforceResidencyBudget(ObjectPool<FileChunk>& fileChunkPool, int keepIndex)
+{
+    // Chunks that cannot be read again are passed over and stay resident
+    int chunkIndex = residency.GetLeastRecent();
+    while (chunkIndex != -1 && residency.IsOverBudget())
+    {
+        int newer = residency.GetNewer(chunkIndex);
+        if (chunkIndex != keepIndex && CanEvictChunk(chunkIndex, fileChunkPool))
         {
-            std::cerr << "Failed to allocate memory for chunk!" << std::endl;
-            return false;
+            EvictChunk(chunkIndex, fileChunkPool);
         }
+        chunkIndex = newer;
+    }
+}
 
-        // Read the chunk data into the allocated memory
-        file.read(static_cast<char*>(chunkData), chunkSize);
+void Level::SetResidencyBudget(size_t bytes)
+{
+    residency.SetBudget(bytes);
+}
 
-        // Create a new FileChunk and load the data
-        FileChunk* chunk = fileChunkPool.Acquire();
-        Asset* asset = assetPool.Acquire();
-        chunk->LoadData(chunkData, chunkSize);
+const ChunkResidency& Level::GetResidency() const
+{
+    return residency;
+}
 
-        // Store the chunk in the chunk pointers array and mark it as loaded
-        chunkPointers.push_back(chunk);  // Store the chunk pointer
-        chunkStatus[chunkPointers.size() - 1] = true;  // Mark the chunk as loaded
+void Level::TrimResidency(ObjectPool<FileChunk>& fileChunkPool)
+{
+    TableUpdate update(*this);
+    EnforceResidencyBudget(fileChunkPool);
+}
 
-        std::cout << "Chunk of size " << chunkSize << " loaded." << std::endl;
-    }
+void Level::SetPrefetchWindow(size_t chunkCount, size_t stagingLimit)
+{
+    prefetcher.reset(chunkCount > 0 ? new ChunkPrefetcher(chunkCount, stagingLimit) : nullptr);
+}
 
-    file.close();
-    return true;
+size_t Level::GetPrefetchWindow() const
+{
+    return prefetcher ? prefetcher->GetWindow() : 0;
 }
 
-bool Level::SaveLevel(const std::string& fileName)
+void Level::PrefetchAfter(int chunkIndex)
 {
-    std::ofstream outFile(fileName, std::ios::binary);
-    if (!outFile)
+    bool sequential = chunkIndex == lastAccessIndex + 1;
+    lastAccessIndex = chunkIndex;
+    if (!prefetcher || !sequential)
     {
-        std::cerr << "Failed to open file: " << fileName << " for writing." << std::endl;
-        return false;
+        return;
     }
 
-    std::cout << "Starting to save level..." << std::endl;
-
-    // Iterate over the chunkStatus array to find loaded chunks
-    for (int chunkIndex = 0; chunkIndex < chunkStatus.size(); ++chunkIndex)
+    // The next chunks that would be read from their chunk files: not added yet, or evicted and not in a level file.
+    // Mapped adds never take staged bytes, those files are only hinted; evicted chunks are read back either way.
+    size_t window = prefetcher->GetWindow();
+    size_t scanEnd = std::min(chunkStatus.size(), chunkIndex + 1 + window * PrefetchScanWindows);
+    std::vector<ChunkPrefetcher::Request> upcoming;
+    for (size_t i = chunkIndex + 1; i < scanEnd && upcoming.size() < window; ++i)
     {
-        if (chunkStatus[chunkIndex])  // Check if the chunk is loaded
+        bool inLevelFile = i < levelTable.size() && levelTable[i].offset != 0;
+        bool needsRead = !chunkStatus[i] || (residency.IsEvicted(static_cast<int>(i)) && !inLevelFile);
+        if (needsRead && !chunkFiles[i].empty())
         {
-            if (chunkIndex < chunkPointers.size())  // Ensure we are within bounds
-            {
-                FileChunk* chunk = chunkPointers[chunkIndex];  // Retrieve the chunk from memory
-                if (!chunk)
-                {
-                    std::cerr << "Error: Chunk pointer is null for index " << chunkIndex << std::endl;
-                    return false;
-                }
-
-                // Write the size of the chunk
-                size_t chunkSize = chunk->GetSize();
-                outFile.write(reinterpret_cast<const char*>(&chunkSize), sizeof(chunkSize));
-
-                // Write the raw chunk data to the file
-                outFile.write(static_cast<const char*>(chunk->GetData()), chunkSize);
-                std::cout << "Chunk " << chunkIndex << " saved successfully." << std::endl;
-            }
-            else
-            {
-                std::cerr << "Error: chunkIndex " << chunkIndex << " out of bounds in chunkPointers!" << std::endl;
-                return false;
-            }
+            bool stage = chunkStatus[i] || ingestMode != ChunkIngestMode::Mapped;
+            upcoming.push_back(ChunkPrefetcher::Request{ chunkFiles[i], chunkSizes[i], stage });
         }
     }
+    prefetcher->Prefetch(upcoming);
+}
 
-    outFile.close();
-    std::cout << "Level saved successfully to " << fileName << std::endl;
-    return true;
+void Level::SetIngestMode(ChunkIngestMode mode)
+{
+    ingestMode = mode;
 }
 
-int Level::GetCurrentChunkIndex() const
+Level::ChunkIngestMode Level::GetIngestMode() const
 {
-    return currentChunkIndex;
+    return ingestMode;
 }
 
-// GetChunkStart: Returns the start position of a chunk in the image buffer
-void* Level::GetChunkStart(int chunkIndex)
+// Removes chunk from the image buffer (zeros out the memory)
+void Level::RemoveChunk(int chunkIndex, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool)
 {
-    if (chunkIndex < 0 || chunkIndex >= chunkPointers.size())
+    TableUpdate update(*this, chunkIndex);
+    if (chunkIndex < 0 || chunkIndex >= chunkStatus.size() || !chunkStatus[chunkIndex])
     {
-        std::cerr << "Invalid chunk index!" << std::endl;
-        return nullptr;
+        LOG_ERROR("Invalid or non-existent chunk to remove!");
+        return;
     }
 
-    // Calculate the start position of the chunk
-    size_t offset = 0;
-    for (int i = 0; i < chunkIndex; ++i)
+    // Get chunk start position and size
+    void* chunkStart = GetChunkStart(chunkIndex);
+    size_t chunkSize = GetChunkSize(chunkIndex);
+    if (!chunkStart || chunkSize == 0)  // unit test
     {
-        offset += GetChunkSize(i);
+        LOG_ERROR("Failed to retrieve chunk memory or size for chunk " << chunkIndex << ".");
+        return;
     }
 
-    return static_cast<char*>(imageBuffer) + offset;
-}
+    // Zero out the chunk memory, the journal keeps the bytes for undo
+    LevelJournal::Command& command = journal.Push(LevelCommandType::RemoveChunk, chunkIndex);
+    if (!ClearChunkSlot(chunkIndex, command, allocator, fileChunkPool))
+    {
+        journal.Discard();
+        return;
+    }
+    ++stats.chunksRemoved;
+
+    LOG_INFO("Chunk " << chunkIndex << " removed.");
+    SaveImageIncremental(DefaultImagePath);
+}
+
+// Undoes the last chunk edit from the bytes held by the journal
+bool Level::Undo(StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool)
+{
+    LevelJournal::Command* command = journal.Undo();
+    if (!command)
+    {
+        LOG_WARNING("No actions to undo.");
+        return false;
+    }
+    TableUpdate update(*this, command->chunkIndex);
+
+    // Undoing an add clears the slot, undoing a remove puts the bytes back
+    bool applied = command->type == LevelCommandType::AddChunk ? ClearChunkSlot(command->chunkIndex, *command, allocator, fileChunkPool) : RestoreChunkSlot(command->chunkIndex, *command, fileChunkPool);
+    if (!applied)
+    {
+        journal.Redo();
+        return false;
+    }
+
+    LOG_INFO("Undid " << (command->type == LevelCommandType::AddChunk ? "AddChunk" : "RemoveChunk") << " for chunk: " << command->chunkIndex);
+    SaveImageIncremental(DefaultImagePath);
+    return true;
+}
+
+// Reapplies the last undone chunk edit
+bool Level::Redo(StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool)
+{
+    LevelJournal::Command* command = journal.Redo();
+    if (!command)
+    {
+        LOG_WARNING("No actions to redo.");
+        return false;
+    }
+    TableUpdate update(*this, command->chunkIndex);
+
+    bool applied = command->type == LevelCommandType::AddChunk ? RestoreChunkSlot(command->chunkIndex, *command, fileChunkPool) : ClearChunkSlot(command->chunkIndex, *command, allocator, fileChunkPool);
+    if (!applied)
+    {
+        journal.Undo();
+        return false;
+    }
+
+    LOG_INFO("Redid " << (command->type == LevelCommandType::AddChunk ? "AddChunk" : "RemoveChunk") << " for chunk: " << command->chunkIndex);
+    SaveImageIncremental(DefaultImagePath);
+    return true;
+}
+
+size_t Level::GetUndoDepth() const
+{
+    return journal.GetUndoDepth();
+}
+
+size_t Level::GetRedoDepth() const
+{
+    return journal.GetRedoDepth();
+}
+
+void LevelStats::Reset()
+{
+    bytesRead = 0;
+    bytesWritten = 0;
+    chunksAdded = 0;
+    chunksRemoved = 0;
+    chunksLoaded = 0;
+    corruptChunks = 0;
+    chunkOpen.Reset();
+    chunkRead.Reset();
+    chunkCopy.Reset();
+    chunkDecode.Reset();
+    batchRead.Reset();
+    assembly.Reset();
+    levelLoad.Reset();
+    levelSave.Reset();
+    imageSave.Reset();
+}
+
+const LevelStats& Level::GetStats() const
+{
+    return stats;
+}
+
+void Level::ResetStats()
+{
+    stats.Reset();
+    residency.ResetStats();
+    if (prefetcher)
+    {
+        prefetcher->ResetStats();
+    }
+}
+
+void Level::WriteStatsJson(JsonWriter& json) const
+{
+    size_t loadedChunks = std::count(chunkStatus.begin(), chunkStatus.end(), true);
+
+    json.BeginObject();
+    json.Key("bytesRead").Value(static_cast<unsigned long long>(stats.bytesRead));
+    json.Key("bytesWritten").Value(static_cast<unsigned long long>(stats.bytesWritten));
+    json.Key("chunksAdded").Value(static_cast<unsigned long long>(stats.chunksAdded));
+    json.Key("chunksRemoved").Value(static_cast<unsigned long long>(stats.chunksRemoved));
+    json.Key("chunksLoaded").Value(static_cast<unsigned long long>(stats.chunksLoaded));
+    json.Key("corruptChunks").Value(static_cast<unsigned long long>(stats.corruptChunks));
+    json.Key("chunkCount").Value(chunkStatus.size());
+    json.Key("chunksInLevel").Value(loadedChunks);
+    json.Key("imageSize").Value(totalSize);
+    json.Key("undoDepth").Value(GetUndoDepth());
+    json.Key("redoDepth").Value(GetRedoDepth());
+    json.Key("journalBytes").Value(journal.GetMemoryUsed());
+    json.Key("residency");
+    residency.WriteStatsJson(json);
+    if (prefetcher)
+    {
+        json.Key("prefetch");
+        prefetcher->WriteStatsJson(json);
+    }
+
+    json.Key("latency").BeginObject();
+    json.Key("chunkOpen"); stats.chunkOpen.WriteJson(json);
+    json.Key("chunkRead"); stats.chunkRead.WriteJson(json);
+    json.Key("chunkCopy"); stats.chunkCopy.WriteJson(json);
+    json.Key("chunkDecode"); stats.chunkDecode.WriteJson(json);
+    json.Key("batchRead"); stats.batchRead.WriteJson(json);
+    json.Key("assembly"); stats.assembly.WriteJson(json);
+    json.Key("levelLoad"); stats.levelLoad.WriteJson(json);
+    json.Key("levelSave"); stats.levelSave.WriteJson(json);
+    json.Key("imageSave"); stats.imageSave.WriteJson(json);
+    json.EndObject();
+
+    // The chunk store is shared by every level in the process
+    ChunkStore& store = ChunkStore::Instance();
+    json.Key("chunkStore").BeginObject();
+    json.Key("blobCount").Value(store.GetBlobCount());
+    json.Key("storedBytes").Value(store.GetStoredBytes());
+    json.Key("dedupHits").Value(store.GetDedupHits());
+    json.Key("allocatorFallbacks").Value(store.GetAllocatorFallbacks());
+    json.Key("allocator"); store.GetAllocator()->WriteStatsJson(json);
+    json.EndObject();
+
+    json.EndObject();
+}
+
+void Level::SetJournalMemoryCap(size_t bytes)
+{
+    journal.SetMemoryCap(bytes);
+}
+
+void Level::SetJournalSpillFile(const std::string& fileName)
+{
+    journal.SetSpillFile(fileName);
+}
+
+// Zeros a chunk's slot, making sure the command holds the bytes first
+bool Level::ClearChunkSlot(int chunkIndex, LevelJournal::Command& command, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool)
+{
+    if (imageBuffer == nullptr || !chunkStatus[chunkIndex] || chunkOffsets[chunkIndex] + chunkSizes[chunkIndex] > totalSize)
+    {
+        LOG_ERROR("Chunk " << chunkIndex << " is not in the image buffer.");
+        return false;
+    }
+
+    char* slot = static_cast<char*>(imageBuffer) + chunkOffsets[chunkIndex];
+    size_t chunkSize = chunkSizes[chunkIndex];
+    if (command.storage == LevelJournal::PayloadStorage::None)
+    {
+        // A chunk still in the level file, or evicted, is read back first. Its slot may never have held its bytes.
+        FileChunk* chunk = chunkPointers[chunkIndex] ? chunkPointers[chunkIndex] : LoadChunk(chunkIndex, allocator, fileChunkPool);
+        if (!chunk)
+        {
+            LOG_ERROR("Chunk " << chunkIndex << " could not be read back to keep for undo.");
+            return false;
+        }
+
+        // Chunk data outside the image buffer survives the clear and is only referenced, the command shares
+        // blobs and mappings so they outlive the chunk. Data that lives in the slot itself has to be copied.
+        const char* chunkData = static_cast<const char*>(chunk->GetData());
+        bool inImage = chunkData >= static_cast<const char*>(imageBuffer) && chunkData < static_cast<const char*>(imageBuffer) + totalSize;
+        if (chunkData && !inImage && chunk->GetSize() == chunkSize)
+        {
+            std::shared_ptr<const void> owner = chunkBlobs[chunkIndex];
+            if (!owner && static_cast<size_t>(chunkIndex) < chunkMappings.size())
+            {
+                owner = chunkMappings[chunkIndex];
+            }
+            journal.KeepReference(command, chunkData, chunkSize, std::move(owner));
+        }
+        else if (!journal.KeepCopy(command, slot, chunkSize))
+        {
+            return false;
+        }
+    }
+
+    memset(slot, 0, chunkSize);
+    MarkImageChanged(chunkOffsets[chunkIndex], chunkOffsets[chunkIndex] + chunkSize);
+    chunkStatus[chunkIndex] = false;
+
+    // The removed chunk's payload is freed once no command shares it, commands holding plain references copy it first
+    FileChunk* chunk = chunkPointers[chunkIndex];
+    if (chunk && fileChunkPool.Owns(chunk))
+    {
+        journal.Detach(chunk->GetData());
+        chunkBlobs[chunkIndex].reset();
+        if (static_cast<size_t>(chunkIndex) < chunkMappings.size())
+        {
+            chunkMappings[chunkIndex].reset();
+        }
+        fileChunkPool.Release(chunk);
+        chunkPointers[chunkIndex] = nullptr;
+    }
+    residency.Remove(chunkIndex);
+    return true;
+}
+
+// Copies a command's bytes back into the chunk's slot
+bool Level::RestoreChunkSlot(int chunkIndex, LevelJournal::Command& command, ObjectPool<FileChunk>& fileChunkPool)
+{
+    bool validIndex = chunkIndex >= 0 && static_cast<size_t>(chunkIndex) < chunkStatus.size();
+    if (imageBuffer == nullptr || !validIndex || command.size != chunkSizes[chunkIndex] || chunkOffsets[chunkIndex] + command.size > totalSize)
+    {
+        LOG_ERROR("Chunk " << chunkIndex << " no longer fits the image buffer.");
+        return false;
+    }
+
+    // A chunk released on removal comes back as a view of its slot, the bytes copied there are the chunk's own
+    char* slot = static_cast<char*>(imageBuffer) + chunkOffsets[chunkIndex];
+    ObjectPool<FileChunk>::Handle newChunk;
+    if (!chunkPointers[chunkIndex])
+    {
+        newChunk = fileChunkPool.AcquireHandle();
+        if (!newChunk)
+        {
+            LOG_ERROR("FileChunk pool is exhausted!");
+            return false;
+        }
+    }
+
+    if (!journal.ReadPayload(command, slot))
+    {
+        return false;
+    }
+
+    if (newChunk)
+    {
+        newChunk.Get()->LoadData(slot, command.size);
+        chunkPointers[chunkIndex] = newChunk.Detach();
+    }
+    MarkImageChanged(chunkOffsets[chunkIndex], chunkOffsets[chunkIndex] + command.size);
+    chunkStatus[chunkIndex] = true;
+    return true;
+}
+
+// Gets starting address of a chunk
+std::string Level::GetChunkFile(int chunkIndex)
+{
+    // Assuming you have a vector `chunkFiles` in your class that stores the file paths of chunks
+    if (chunkIndex >= 0 && chunkIndex < chunkFiles.size())
+    {
+        return chunkFiles[chunkIndex];  // Returns the file corresponding to the chunk index
+    }
+    else
+    {
+        LOG_ERROR("Invalid chunk index!");
+        return "";
+    }
+}
+
+// Saves current image buffer to output file
+bool Level::SaveImage(const std::string& outputImagePath)
+{
+    ScopedLatency saveTime(stats.imageSave);
+    std::ofstream outputImage(outputImagePath, std::ios::binary);
+    if (!outputImage)
+    {
+        LOG_ERROR("Failed to save image to: " << outputImagePath);
+        return false;
+    }
+
+    outputImage.write(static_cast<char*>(imageBuffer), totalSize);
+    if (!outputImage)
+    {
+        LOG_ERROR("Failed to save image to: " << outputImagePath);
+        savedImagePath.clear();
+        return false;
+    }
+    // unit test - save to image filepath
+    LOG_DEBUG("Image saved to " << outputImagePath);
+    stats.bytesWritten += totalSize;
+
+    // The file now matches the buffer, later saves only need the ranges changed from here on
+    savedImagePath = outputImagePath;
+    dirtyRanges.Clear();
+    return true;
+}
+
+// Writes only the dirty ranges into the previously saved image, in place
+bool Level::SaveImageIncremental(const std::string& outputImagePath)
+{
+    // Anything but the image this buffer was last saved to needs a full rewrite
+    if (outputImagePath != savedImagePath)
+    {
+        return SaveImage(outputImagePath);
+    }
+
+    if (dirtyRanges.IsEmpty())
+    {
+        return true;
+    }
+
+    // Writes go in place, so the file must still be the full image
+    IORequest existing = IORequest::Stat(outputImagePath);
+    AsyncIO::ExecuteSync(existing);
+    if (existing.result != static_cast<int64_t>(totalSize))
+    {
+        return SaveImage(outputImagePath);
+    }
+
+    // Every dirty range is one positional write of the same batch
+    ScopedLatency saveTime(stats.imageSave);
+    std::vector<IORequest> writes;
+    size_t dirtyBytes = 0;
+    for (const auto& range : dirtyRanges.GetRanges())
+    {
+        writes.push_back(IORequest::Write(outputImagePath, static_cast<char*>(imageBuffer) + range.begin, range.end - range.begin, range.begin));
+        dirtyBytes += range.end - range.begin;
+    }
+
+    if (!AsyncIO::Default().Execute(writes))
+    {
+        LOG_WARNING("Failed to update image: " << outputImagePath << ", rewriting it.");
+        saveTime.Stop();
+        return SaveImage(outputImagePath);
+    }
+    stats.bytesWritten += dirtyBytes;
+
+    dirtyRanges.Clear();
+    return true;
+}
+
+// Calculate total size of chunk files
+size_t Level::CalculateTotalChunkSize(const std::vector<std::string>& chunkFiles)
+{
+    size_t totalSize = 0;
+    for (size_t chunkSize : CalculateChunkSizes(chunkFiles))
+    {
+        totalSize += chunkSize;
+    }
+    return totalSize;
+}
+
+// Calculate size of each chunk file
+std::vector<size_t> Level::CalculateChunkSizes(const std::vector<std::string>& chunkFiles)
+{
+    // Cataloged sizes are answered from memory, SetChunkManifest re-stats the files before laying out slots
+    // and chunk reads invalidate files that no longer match
+    ChunkCatalog& catalog = ChunkCatalog::Instance();
+    std::vector<size_t> chunkSizes = catalog.GetSizes(chunkFiles);
+
+    ChunkCatalog::Entry entry;
+    for (size_t i = 0; i < chunkFiles.size(); ++i)
+    {
+        if (chunkSizes[i] == 0 && !catalog.Find(chunkFiles[i], entry))
+        {
+            LOG_ERROR("Failed to open chunk file: " << chunkFiles[i]);
+        }
+    }
+    return chunkSizes;
+}
+
+// Gets image buffer in main loop
+void* Level::GetImageBuffer() const
+{
+    return imageBuffer;
+}
+
+size_t Level::GetImageSize() const
+{
+    return imageBuffer ? totalSize : 0;
+}
+
+Level::ChunkTableView Level::ReadChunkTable() const
+{
+    static const LevelChunkTable EmptyTable = { 0, 0, 0, {} };
+
+    // Pin first, so the table loaded below is not freed while the view holds it
+    EpochDomain::Guard guard = tableEpochs.Pin();
+    const LevelChunkTable* table = publishedTable.load();
+    return ChunkTableView(std::move(guard), table ? table : &EmptyTable);
+}
+
+void Level::PublishChunkTable()
+{
+    const LevelChunkTable* previous = publishedTable.load();
+    LevelChunkTable* table = new LevelChunkTable;
+    table->version = ++tableVersion;
+    table->imageSize = imageBuffer ? totalSize : 0;
+    table->chunkCount = chunkStatus.size();
+
+    // Edits of single chunks share every other page with the previous table, so publishing costs one page
+    size_t pageCount = (chunkStatus.size() + LevelChunkTable::PageSize - 1) / LevelChunkTable::PageSize;
+    if (tableLayoutChanged || !previous || previous->chunkCount != table->chunkCount)
+    {
+        table->pages.reserve(pageCount);
+        for (size_t page = 0; page < pageCount; ++page)
+        {
+            table->pages.push_back(BuildChunkTablePage(page));
+        }
+    }
+    else
+    {
+        table->pages = previous->pages;
+        std::sort(changedTablePages.begin(), changedTablePages.end());
+        changedTablePages.erase(std::unique(changedTablePages.begin(), changedTablePages.end()), changedTablePages.end());
+        for (size_t page : changedTablePages)
+        {
+            if (page < pageCount)
+            {
+                table->pages[page] = BuildChunkTablePage(page);
+            }
+        }
+    }
+    tableLayoutChanged = false;
+    changedTablePages.clear();
+
+    previous = publishedTable.exchange(table);
+    if (previous)
+    {
+        tableEpochs.Retire([previous]() { delete previous; });
+    }
+}
+
+std::shared_ptr<const LevelChunkTable::Page> Level::BuildChunkTablePage(size_t page) const
+{
+    size_t begin = page * LevelChunkTable::PageSize;
+    size_t end = std::min(begin + LevelChunkTable::PageSize, chunkStatus.size());
+    std::shared_ptr<LevelChunkTable::Page> chunks = std::make_shared<LevelChunkTable::Page>(end - begin);
+    for (size_t i = begin; i < end; ++i)
+    {
+        LevelChunkTable::Chunk& chunk = (*chunks)[i - begin];
+        chunk.offset = chunkOffsets[i];
+        chunk.size = chunkSizes[i];
+        chunk.loaded = chunkStatus[i];
+        if (!chunk.loaded)
+        {
+            continue;
+        }
+
+        // Readers share ownership of the bytes, so they outlive an eviction or a new manifest while a view holds them
+        if (chunkBlobs[i])
+        {
+            chunk.payload = std::shared_ptr<const void>(chunkBlobs[i], chunkBlobs[i]->GetData());
+        }
+        else if (i < chunkMappings.size() && chunkMappings[i] && chunkPointers[i])
+        {
+            chunk.payload = std::shared_ptr<const void>(chunkMappings[i], chunkMappings[i]->GetData());
+        }
+    }
+    return chunks;
+}
+
+void Level::TakeImageChanges(DirtyRangeSet& changes)
+{
+    changes = imageChanges;
+    imageChanges.Clear();
+}
+
+void Level::MarkImageChanged(size_t begin, size_t end)
+{
+    dirtyRanges.Add(begin, end);
+    imageChanges.Add(begin, end);
+}
+
+// Checks that the header's chunk table lies inside a file of fileSize bytes
+static bool ValidateLevelHeader(const LevelFileHeader& header, uint64_t fileSize, const std::string& fileName)
+{
+    if (header.version != LevelFileVersion || header.entrySize == 0 || header.entrySize > 4096)
+    {
+        LOG_ERROR("Unsupported level file version " << header.version << " in " << fileName);
+        return false;
+    }
+
+    uint64_t tableSize = static_cast<uint64_t>(header.chunkCount) * header.entrySize;
+    if (header.tableOffset < sizeof(LevelFileHeader) || header.tableOffset > fileSize || tableSize > fileSize - header.tableOffset)
+    {
+        LOG_ERROR("Chunk table in " << fileName << " is truncated.");
+        return false;
+    }
+    return true;
+}
+
+// Decodes the raw chunk table and checks every entry against the file bounds
+static bool ParseLevelTable(const LevelFileHeader& header, const char* tableBytes, uint64_t fileSize, const std::string& fileName, std::vector<LevelChunkEntry>& table)
+{
+    table.assign(header.chunkCount, LevelChunkEntry());
+    std::vector<bool> seen;
+    for (uint32_t i = 0; i < header.chunkCount; ++i)
+    {
+        LevelChunkEntry& entry = table[i];
+        memcpy(&entry, tableBytes + static_cast<size_t>(i) * header.entrySize, std::min<size_t>(header.entrySize, sizeof(LevelChunkEntry)));
+
+        // Uncompressed payloads are stored as is, older tables leave storedSize at 0
+        bool compressed = (entry.flags & LevelChunkFlag_Compressed) != 0;
+        bool empty = (entry.flags & LevelChunkFlag_Empty) != 0;
+        if (!compressed && !empty)
+        {
+            entry.storedSize = entry.size;
+        }
+
+        // A block cannot expand by more than 255 times, anything larger is not a real chunk.
+        // Empty slots only keep their size, they have nothing stored.
+        bool validSize = compressed ? entry.size <= entry.storedSize * 255 + 255 : true;
+        bool validRange = empty ? entry.offset == 0 && entry.storedSize == 0 && !compressed
+                                : entry.offset >= sizeof(LevelFileHeader) && entry.offset <= fileSize && entry.storedSize <= fileSize - entry.offset;
+        bool validIndex = entry.index < LevelMaxChunkIndex && (entry.index >= seen.size() || !seen[entry.index]);
+        if (!validSize || !validRange || !validIndex)
+        {
+            LOG_ERROR("Chunk table entry " << i << " in " << fileName << " is corrupt.");
+            return false;
+        }
+
+        if (entry.index >= seen.size())
+        {
+            seen.resize(entry.index + 1, false);
+        }
+        seen[entry.index] = true;
+    }
+    return true;
+}
+
+// Checks a stored payload against its table checksum, entries written without one always pass
+static bool VerifyPayload(const LevelChunkEntry& entry, const void* storedData)
+{
+    return !(entry.flags & LevelChunkFlag_Checksum) || Crc32c::Compute(storedData, static_cast<size_t>(entry.storedSize)) == entry.checksum;
+}
+
+bool Level::LoadLevel(const std::string& filename, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool, ObjectPool<Asset>& assetPool)
+{
+    TableUpdate update(*this);
+    ScopedLatency loadTime(stats.levelLoad);
+    std::ifstream file(filename, std::ios::binary);
+    if (!file)
+    {
+        LOG_ERROR("Failed to open file: " << filename << " for reading.");
+        return false;
+    }
+
+    // Clear current chunk data
+    ReleaseChunks(fileChunkPool);
+    chunkStatus.assign(chunkStatus.size(), false);
+    levelFileName.clear();
+    levelTable.clear();
+
+    // Files without the header are version 1
+    LevelFileHeader header = {};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || header.magic != LevelFileMagic)
+    {
+        file.clear();
+        file.seekg(0, std::ios::beg);
+        return LoadLevelV1(file, allocator, fileChunkPool, assetPool);
+    }
+
+    file.seekg(0, std::ios::end);
+    uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+    if (!ValidateLevelHeader(header, fileSize, filename))
+    {
+        return false;
+    }
+
+    // Only the chunk table is read here, payloads stay on disk until LoadChunk asks for them
+    std::vector<char> tableBytes(static_cast<size_t>(header.chunkCount) * header.entrySize);
+    file.seekg(header.tableOffset, std::ios::beg);
+    std::vector<LevelChunkEntry> table;
+    if (!file.read(tableBytes.data(), tableBytes.size()) || !ParseLevelTable(header, tableBytes.data(), fileSize, filename, table))
+    {
+        return false;
+    }
+    stats.bytesRead += sizeof(header) + tableBytes.size();
+
+    for (const auto& entry : table)
+    {
+        if (entry.index >= levelTable.size())
+        {
+            levelTable.resize(entry.index + 1, LevelChunkEntry());
+        }
+        levelTable[entry.index] = entry;
+    }
+
+    // The chunk table defines the chunk count and slot sizes, empty slots included
+    ResizeChunkTable(levelTable.size());
+    for (size_t i = 0; i < levelTable.size(); ++i)
+    {
+        chunkStatus[i] = levelTable[i].offset != 0;
+        chunkSizes[i] = static_cast<size_t>(levelTable[i].size);
+    }
+    RebuildChunkOffsets(0);
+    levelFileName = filename;
+
+    LOG_INFO("Level table with " << header.chunkCount << " chunks loaded.");
+    return true;
+}
+
+bool Level::VerifyLevel(const std::string& fileName, unsigned int workerCount)
+{
+    MappedFile file;
+    if (!file.Open(fileName))
+    {
+        LOG_ERROR("Failed to open file: " << fileName << " for reading.");
+        return false;
+    }
+    const char* bytes = static_cast<const char*>(file.GetData());
+    uint64_t fileSize = file.GetSize();
+
+    LevelFileHeader header = {};
+    if (fileSize >= sizeof(header))
+    {
+        memcpy(&header, bytes, sizeof(header));
+    }
+
+    if (header.magic != LevelFileMagic)
+    {
+        // Version 1 records carry no checksums, only their lengths can be checked
+        uint64_t position = 0;
+        size_t recordCount = 0;
+        while (position < fileSize)
+        {
+            size_t chunkSize = 0;
+            if (fileSize - position < sizeof(chunkSize))
+            {
+                LOG_ERROR("Chunk record " << recordCount << " in " << fileName << " is truncated.");
+                return false;
+            }
+            memcpy(&chunkSize, bytes + position, sizeof(chunkSize));
+            position += sizeof(chunkSize);
+            if (chunkSize > fileSize - position)
+            {
+                LOG_ERROR("Chunk record " << recordCount << " in " << fileName << " is truncated.");
+                return false;
+            }
+            position += chunkSize;
+            ++recordCount;
+        }
+
+        LOG_INFO(fileName << ": version 1 file with " << recordCount << " chunk records, no checksums to verify.");
+        return true;
+    }
+
+    std::vector<LevelChunkEntry> table;
+    if (!ValidateLevelHeader(header, fileSize, fileName) || !ParseLevelTable(header, bytes + header.tableOffset, fileSize, fileName, table))
+    {
+        return false;
+    }
+
+    // Payloads shared by several entries are checked once, straight from the mapping
+    std::vector<size_t> payloads;
+    std::unordered_set<uint64_t> offsets;
+    size_t uncheckedCount = 0;
+    for (size_t t = 0; t < table.size(); ++t)
+    {
+        if (table[t].flags & LevelChunkFlag_Empty)
+        {
+            continue;
+        }
+        if (!(table[t].flags & LevelChunkFlag_Checksum))
+        {
+            ++uncheckedCount;
+        }
+        else if (offsets.insert(table[t].offset).second)
+        {
+            payloads.push_back(t);
+        }
+    }
+
+    std::vector<char> corrupt(payloads.size(), 0);
+    WorkerPool::Default().ParallelFor(payloads.size(), workerCount, [&](size_t p)
+    {
+        const LevelChunkEntry& entry = table[payloads[p]];
+        corrupt[p] = !VerifyPayload(entry, bytes + entry.offset);
+    });
+
+    bool valid = true;
+    for (size_t p = 0; p < payloads.size(); ++p)
+    {
+        if (corrupt[p])
+        {
+            LOG_ERROR("Chunk " << table[payloads[p]].index << " in " << fileName << " is corrupt.");
+            valid = false;
+        }
+    }
+
+    LOG_INFO(fileName << ": " << payloads.size() << " payloads verified, " << uncheckedCount << " chunks without checksums.");
+    return valid;
+}
+
+bool Level::LoadLevelV1(std::ifstream& file, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool, ObjectPool<Asset>& assetPool)
+{
+    file.seekg(0, std::ios::end);
+    uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+    file.seekg(0, std::ios::beg);
+
+    // Read chunk data from the file
+    size_t chunkCount = 0;
+    while (!file.eof())
+    {
+        size_t chunkSize = 0;
+
+        // Read the size of the chunk
+        file.read(reinterpret_cast<char*>(&chunkSize), sizeof(chunkSize));
+        if (file.eof())
+            break;  // Stop if we've reached the end of the file
+
+        // The length prefix is not trusted further than the bytes left in the file
+        uint64_t remaining = fileSize - static_cast<uint64_t>(file.tellg());
+        if (chunkSize > remaining)
+        {
+            LOG_ERROR("Chunk record is truncated!");
+            return false;
+        }
+
+        // Read the chunk data straight into chunk store memory
+        ChunkStore::PendingBlob pending = ChunkStore::Instance().Reserve(chunkSize);
+        if (!pending)
+        {
+            LOG_ERROR("Failed to allocate memory for chunk!");
+            return false;
+        }
+        if (!file.read(static_cast<char*>(pending.GetData()), chunkSize))
+        {
+            LOG_ERROR("Chunk record is truncated!");
+            return false;
+        }
+        stats.bytesRead += sizeof(chunkSize) + chunkSize;
+        std::shared_ptr<const ChunkStore::Blob> blob = ChunkStore::Instance().Commit(std::move(pending));
+
+        // Create a new FileChunk and load the data
+        FileChunk* chunk = fileChunkPool.Acquire();
+        ObjectPool<Asset>::Handle asset = assetPool.AcquireHandle();
+        if (!chunk)
+        {
+            LOG_ERROR("FileChunk pool is exhausted!");
+            return false;
+        }
+        chunk->LoadView(blob->GetData(), chunkSize);
+
+        // Store the chunk in the chunk pointers array and mark it as loaded
+        ResizeChunkTable(std::max(chunkCount + 1, chunkStatus.size()));
+        chunkPointers[chunkCount] = chunk;  // Store the chunk pointer
+        chunkBlobs[chunkCount] = blob;
+        chunkSizes[chunkCount] = chunkSize;
+        chunkStatus[chunkCount] = true;  // Mark the chunk as loaded
+        ++chunkCount;
+        ++stats.chunksLoaded;
+
+        LOG_DEBUG("Chunk of size " << chunkSize << " loaded.");
+    }
+
+    file.close();
+    RebuildChunkOffsets(0);
+    return true;
+}
+
+FileChunk* Level::LoadChunk(int chunkIndex, StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool)
+{
+    TableUpdate update(*this, chunkIndex);
+    if (chunkIndex < 0 || static_cast<size_t>(chunkIndex) >= chunkStatus.size() || !chunkStatus[chunkIndex])
+    {
+        LOG_ERROR("Invalid or non-existent chunk to load!");
+        return nullptr;
+    }
+
+    // Already in memory
+    if (chunkPointers[chunkIndex])
+    {
+        residency.Touch(chunkIndex);
+        PrefetchAfter(chunkIndex);
+        return chunkPointers[chunkIndex];
+    }
+
+    if (static_cast<size_t>(chunkIndex) >= levelTable.size() || levelTable[chunkIndex].offset == 0)
+    {
+        // Evicted before it was saved to a level file, it comes back from its chunk file
+        if (residency.IsEvicted(chunkIndex) && !chunkFiles[chunkIndex].empty())
+        {
+            std::shared_ptr<const ChunkStore::Blob> blob = ReadChunkFile(chunkIndex, chunkFiles[chunkIndex]);
+            if (blob && Crc32c::Compute(blob->GetData(), blob->GetSize()) != evictedChecksums[chunkIndex])
+            {
+                LOG_ERROR("Chunk file " << chunkFiles[chunkIndex] << " changed after chunk " << chunkIndex << " was evicted.");
+                ChunkCatalog::Instance().Invalidate(chunkFiles[chunkIndex]);
+                return nullptr;
+            }
+
+            FileChunk* chunk = blob ? fileChunkPool.Acquire() : nullptr;
+            if (!chunk)
+            {
+                LOG_ERROR("Failed to reload chunk " << chunkIndex << " from " << chunkFiles[chunkIndex]);
+                return nullptr;
+            }
+
+            chunkBlobs[chunkIndex] = blob;
+            chunk->LoadView(blob->GetData(), blob->GetSize());
+            chunkPointers[chunkIndex] = chunk;
+            residency.Insert(chunkIndex, blob->GetSize());
+            EnforceResidencyBudget(fileChunkPool, chunkIndex);
+            PrefetchAfter(chunkIndex);
+            return chunk;
+        }
+
+        LOG_ERROR("Chunk " << chunkIndex << " is not stored in a level file.");
+        return nullptr;
+    }
+
+    const LevelChunkEntry& entry = levelTable[chunkIndex];
+    ScopedLatency openTime(stats.chunkOpen);
+    std::ifstream file(levelFileName, std::ios::binary);
+    openTime.Stop();
+    if (!file)
+    {
+        LOG_ERROR("Failed to open file: " << levelFileName << " for reading.");
+        return nullptr;
+    }
+
+    // Payloads end up in chunk store memory, raw ones are read straight into it and compressed ones are
+    // staged in the allocator and decompressed into it
+    size_t chunkSize = static_cast<size_t>(entry.size);
+    size_t storedSize = static_cast<size_t>(entry.storedSize);
+    bool compressed = (entry.flags & LevelChunkFlag_Compressed) != 0;
+    ChunkStore::PendingBlob pending = ChunkStore::Instance().Reserve(chunkSize);
+    StackAllocator::ScopedMarker allocation(allocator);
+    void* storedData = compressed ? allocator.Allocate(storedSize, ChunkDataAlignment) : pending.GetData();
+    if (!pending || !storedData)
+    {
+        LOG_ERROR("Failed to allocate memory for chunk " << chunkIndex);
+        return nullptr;
+    }
+
+    ScopedLatency readTime(stats.chunkRead);
+    file.seekg(entry.offset, std::ios::beg);
+    bool read = static_cast<bool>(file.read(static_cast<char*>(storedData), storedSize));
+    readTime.Stop();
+    if (!read)
+    {
+        LOG_ERROR("Failed to read chunk " << chunkIndex << " from " << levelFileName);
+        return nullptr;
+    }
+    stats.bytesRead += storedSize;
+
+    ScopedLatency decodeTime(stats.chunkDecode);
+    bool decoded = VerifyPayload(entry, storedData) && (!compressed || BlockCodec::Decompress(storedData, storedSize, pending.GetData(), chunkSize));
+    decodeTime.Stop();
+    if (!decoded)
+    {
+        ++stats.corruptChunks;
+        LOG_ERROR("Chunk " << chunkIndex << " in " << levelFileName << " is corrupt.");
+        return nullptr;
+    }
+
+    FileChunk* chunk = fileChunkPool.Acquire();
+    if (!chunk)
+    {
+        LOG_ERROR("FileChunk pool is exhausted!");
+        return nullptr;
+    }
+
+    // Chunks identical to one already in memory, in this level or another, share its bytes
+    chunkBlobs[chunkIndex] = ChunkStore::Instance().Commit(std::move(pending));
+    chunk->LoadView(chunkBlobs[chunkIndex]->GetData(), chunkSize);
+    chunkPointers[chunkIndex] = chunk;
+    ++stats.chunksLoaded;
+    residency.Insert(chunkIndex, chunkSize);
+    EnforceResidencyBudget(fileChunkPool, chunkIndex);
+    PrefetchAfter(chunkIndex);
+
+    LOG_DEBUG("Chunk of size " << chunkSize << " loaded.");
+    return chunk;
+}
+
+bool Level::LoadAllChunks(StackAllocator& allocator, ObjectPool<FileChunk>& fileChunkPool, unsigned int workerCount)
+{
+    TableUpdate update(*this);
+    std::vector<int> pending;
+    for (size_t i = 0; i < chunkStatus.size(); ++i)
+    {
+        if (chunkStatus[i] && !chunkPointers[i] && i < levelTable.size() && levelTable[i].offset != 0)
+        {
+            pending.push_back(static_cast<int>(i));
+        }
+    }
+
+    // Under a residency budget only the chunks that fit next to the resident ones are loaded, in index order
+    if (residency.GetBudget() != 0)
+    {
+        size_t room = residency.GetBudget() > residency.GetResidentBytes() ? residency.GetBudget() - residency.GetResidentBytes() : 0;
+        size_t fitting = 0;
+        for (size_t bytes = 0; fitting < pending.size() && bytes + levelTable[pending[fitting]].size <= room; ++fitting)
+        {
+            bytes += static_cast<size_t>(levelTable[pending[fitting]].size);
+        }
+        pending.resize(fitting);
+    }
+    if (pending.empty())
+    {
+        return true;
+    }
+
+    // Chunk store memory for every payload is taken up front, raw payloads are read straight into it.
+    // Compressed ones are staged in the allocator on this thread, it is not thread-safe.
+    StackAllocator::ScopedMarker staging(allocator);
+    std::vector<ChunkStore::PendingBlob> reserved(pending.size());
+    std::vector<void*> storedData(pending.size());
+    std::vector<IORequest> reads;
+    reads.reserve(pending.size());
+    for (size_t p = 0; p < pending.size(); ++p)
+    {
+        const LevelChunkEntry& entry = levelTable[pending[p]];
+        reserved[p] = ChunkStore::Instance().Reserve(static_cast<size_t>(entry.size));
+        storedData[p] = (entry.flags & LevelChunkFlag_Compressed) ? allocator.Allocate(static_cast<size_t>(entry.storedSize), ChunkDataAlignment) : reserved[p].GetData();
+        if (!reserved[p] || !storedData[p])
+        {
+            LOG_ERROR("Failed to allocate memory for chunk " << pending[p]);
+            return false;
+        }
+        reads.push_back(IORequest::Read(levelFileName, storedData[p], static_cast<size_t>(entry.storedSize), entry.offset));
+    }
+
+    ScopedLatency readTime(stats.batchRead);
+    bool read = AsyncIO::Default().Execute(reads);
+    readTime.Stop();
+    if (!read)
+    {
+        LOG_ERROR("Failed to read chunks from " << levelFileName);
+        return false;
+    }
+    for (const auto& request : reads)
+    {
+        stats.bytesRead += request.size;
+    }
+
+    // FileChunks come from the pool on this thread too, they go back to it if anything fails
+    std::vector<ObjectPool<FileChunk>::Handle> chunks;
+    chunks.reserve(pending.size());
+    for (size_t p = 0; p < pending.size(); ++p)
+    {
+        chunks.push_back(fileChunkPool.AcquireHandle());
+        if (!chunks.back())
+        {
+            LOG_ERROR("FileChunk pool is exhausted!");
+            return false;
+        }
+    }
+
+    // Verify, decompress into blob memory and commit across the cores, every task only touches its own chunk
+    std::vector<std::shared_ptr<const ChunkStore::Blob>> blobs(pending.size());
+    WorkerPool::Default().ParallelFor(pending.size(), workerCount, [&](size_t p)
+    {
+        const LevelChunkEntry& entry = levelTable[pending[p]];
+        ScopedLatency decodeTime(stats.chunkDecode);
+        if (!VerifyPayload(entry, storedData[p]))
+        {
+            return;
+        }
+        if ((entry.flags & LevelChunkFlag_Compressed) && !BlockCodec::Decompress(storedData[p], static_cast<size_t>(entry.storedSize), reserved[p].GetData(), reserved[p].GetSize()))
+        {
+            return;
+        }
+        decodeTime.Stop();
+        blobs[p] = ChunkStore::Instance().Commit(std::move(reserved[p]));
+    });
+
+    for (size_t p = 0; p < pending.size(); ++p)
+    {
+        if (!blobs[p])
+        {
+            ++stats.corruptChunks;
+            LOG_ERROR("Chunk " << pending[p] << " in " << levelFileName << " is corrupt.");
+            return false;
+        }
+    }
+
+    for (size_t p = 0; p < pending.size(); ++p)
+    {
+        int chunkIndex = pending[p];
+        chunks[p]->LoadView(blobs[p]->GetData(), blobs[p]->GetSize());
+        chunkBlobs[chunkIndex] = blobs[p];
+        chunkPointers[chunkIndex] = chunks[p].Detach();
+        residency.Insert(chunkIndex, blobs[p]->GetSize());
+    }
+    stats.chunksLoaded += pending.size();
+
+    LOG_INFO(pending.size() << " chunks loaded.");
+    return true;
+}
+
+// Copies size bytes starting at offset in source to the end of destination, checksumming them on the way
+static bool CopyFileRange(std::ifstream& source, uint64_t offset, uint64_t size, std::ofstream& destination, uint32_t& checksum)
+{
+    char buffer[64 * 1024];
+    checksum = 0;
+    source.seekg(offset, std::ios::beg);
+    while (size > 0 && source)
+    {
+        size_t blockSize = static_cast<size_t>(std::min<uint64_t>(size, sizeof(buffer)));
+        source.read(buffer, blockSize);
+        checksum = Crc32c::Compute(buffer, static_cast<size_t>(source.gcount()), checksum);
+        destination.write(buffer, source.gcount());
+        size -= source.gcount();
+    }
+    return size == 0 && destination.good();
+}
+
+bool Level::SaveLevel(const std::string& fileName, bool compress)
+{
+    ScopedLatency saveTime(stats.levelSave);
+    LOG_INFO("Starting to save level...");
+
+    // Build the chunk table for every slot. Loaded chunks are in memory or still in the current level file,
+    // removed ones keep their slot size so the layout survives a reload.
+    std::vector<LevelChunkEntry> table;
+    for (int chunkIndex = 0; chunkIndex < chunkStatus.size(); ++chunkIndex)
+    {
+        LevelChunkEntry entry = {};
+        entry.index = chunkIndex;
+        entry.flags = LevelChunkFlag_None;
+        if (!chunkStatus[chunkIndex])
+        {
+            entry.size = chunkSizes[chunkIndex];
+            entry.flags = LevelChunkFlag_Empty;
+        }
+        else if (chunkPointers[chunkIndex])
+        {
+            entry.size = chunkPointers[chunkIndex]->GetSize();
+            entry.storedSize = entry.size;
+        }
+        else if (static_cast<size_t>(chunkIndex) < levelTable.size() && levelTable[chunkIndex].offset != 0)
+        {
+            // Copied over as stored, compressed or not
+            entry.size = levelTable[chunkIndex].size;
+            entry.storedSize = levelTable[chunkIndex].storedSize;
+            entry.flags = levelTable[chunkIndex].flags;
+            entry.checksum = levelTable[chunkIndex].checksum;
+        }
+        else if (residency.IsEvicted(chunkIndex) && !chunkFiles[chunkIndex].empty())
+        {
+            // Evicted before it was ever saved, copied from its chunk file uncompressed and checked against the evicted bytes
+            entry.size = chunkSizes[chunkIndex];
+            entry.storedSize = entry.size;
+            entry.checksum = evictedChecksums[chunkIndex];
+            entry.flags = LevelChunkFlag_Checksum;
+        }
+        else
+        {
+            LOG_ERROR("Error: No data for chunk index " << chunkIndex);
+            return false;
+        }
+        table.push_back(entry);
+    }
+
+    // Identical payloads are written once and every entry holding them shares the offset.
+    // In-memory chunks match by content hash plus a byte compare, chunks still on disk by their old offset.
+    std::vector<size_t> payloadOwner(table.size());
+    std::unordered_multimap<uint64_t, size_t> ownersByHash;
+    std::unordered_map<uint64_t, size_t> ownersByFileOffset;
+    for (size_t t = 0; t < table.size(); ++t)
+    {
+        payloadOwner[t] = t;
+        if (table[t].flags & LevelChunkFlag_Empty)
+        {
+            continue;
+        }
+
+        uint32_t chunkIndex = table[t].index;
+        FileChunk* chunk = chunkPointers[chunkIndex];
+        uint64_t fileOffset = chunkIndex < levelTable.size() ? levelTable[chunkIndex].offset : 0;
+        auto fileOwner = ownersByFileOffset.find(fileOffset);
+        if (fileOffset != 0 && fileOwner != ownersByFileOffset.end())
+        {
+            payloadOwner[t] = fileOwner->second;
+            continue;
+        }
+        if (!chunk)
+        {
+            ownersByFileOffset.emplace(fileOffset, t);
+            continue;
+        }
+
+        const void* data = chunk->GetData();
+        uint64_t hash = chunkBlobs[chunkIndex] ? chunkBlobs[chunkIndex]->GetHash() : ChunkStore::Hash(data, table[t].size);
+        auto candidates = ownersByHash.equal_range(hash);
+        for (auto it = candidates.first; it != candidates.second; ++it)
+        {
+            FileChunk* owner = chunkPointers[table[it->second].index];
+            if (table[it->second].size == table[t].size && (owner->GetData() == data || memcmp(owner->GetData(), data, table[t].size) == 0))
+            {
+                payloadOwner[t] = it->second;
+                break;
+            }
+        }
+        if (payloadOwner[t] == t)
+        {
+            ownersByHash.emplace(hash, t);
+        }
+
+        // A chunk loaded from the level file still stands for its old payload
+        if (fileOffset != 0)
+        {
+            ownersByFileOffset.emplace(fileOffset, payloadOwner[t]);
+        }
+    }
+
+    // Compress and checksum the in-memory payloads this save writes in parallel, blocks that do not shrink are stored raw
+    std::vector<std::vector<char>> compressedPayloads(table.size());
+    WorkerPool::Default().ParallelFor(table.size(), 0, [&](size_t t)
+    {
+        FileChunk* chunk = chunkPointers[table[t].index];
+        if (payloadOwner[t] != t || !chunk || (table[t].flags & LevelChunkFlag_Empty))
+        {
+            return;
+        }
+
+        size_t chunkSize = static_cast<size_t>(table[t].size);
+        std::vector<char>& block = compressedPayloads[t];
+        if (compress)
+        {
+            block.resize(BlockCodec::GetMaxCompressedSize(chunkSize));
+            size_t blockSize = BlockCodec::Compress(chunk->GetData(), chunkSize, block.data(), block.size());
+            if (blockSize == 0 || blockSize >= chunkSize)
+            {
+                std::vector<char>().swap(block);
+            }
+            else
+            {
+                block.resize(blockSize);
+                table[t].flags |= LevelChunkFlag_Compressed;
+                table[t].storedSize = blockSize;
+            }
+        }
+
+        const void* storedData = block.empty() ? chunk->GetData() : block.data();
+        table[t].checksum = Crc32c::Compute(storedData, static_cast<size_t>(table[t].storedSize));
+        table[t].flags |= LevelChunkFlag_Checksum;
+    });
+
+    // Payloads follow the header and chunk table back to back
+    uint64_t payloadOffset = sizeof(LevelFileHeader) + table.size() * sizeof(LevelChunkEntry);
+    for (size_t t = 0; t < table.size(); ++t)
+    {
+        if (table[t].flags & LevelChunkFlag_Empty)
+        {
+            continue;
+        }
+        if (payloadOwner[t] != t)
+        {
+            const LevelChunkEntry& owner = table[payloadOwner[t]];
+            table[t].offset = owner.offset;
+            table[t].flags = owner.flags;
+            table[t].storedSize = owner.storedSize;
+            table[t].checksum = owner.checksum;
+            continue;
+        }
+        table[t].offset = payloadOffset;
+        payloadOffset += table[t].storedSize;
+    }
+
+    LevelFileHeader header = {};
+    header.magic = LevelFileMagic;
+    header.version = LevelFileVersion;
+    header.chunkCount = static_cast<uint32_t>(table.size());
+    header.entrySize = sizeof(LevelChunkEntry);
+    header.tableOffset = sizeof(LevelFileHeader);
+
+    // Write to a temporary file first, chunks that are not loaded may still be read from the file being replaced
+    const std::string tempFileName = fileName + ".tmp";
+    {
+        std::ofstream outFile(tempFileName, std::ios::binary);
+        if (!outFile)
+        {
+            LOG_ERROR("Failed to open file: " << tempFileName << " for writing.");
+            return false;
+        }
+
+        std::ifstream levelFile;
+        if (!levelFileName.empty())
+        {
+            levelFile.open(levelFileName, std::ios::binary);
+        }
+
+        outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        outFile.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(LevelChunkEntry));
+
+        for (size_t t = 0; t < table.size(); ++t)
+        {
+            const LevelChunkEntry& entry = table[t];
+            FileChunk* chunk = chunkPointers[entry.index];
+            if (entry.flags & LevelChunkFlag_Empty)
+            {
+                continue;
+            }
+            if (payloadOwner[t] != t)
+            {
+                LOG_DEBUG("Chunk " << entry.index << " shares the payload of chunk " << table[payloadOwner[t]].index << ".");
+                continue;
+            }
+
+            if (chunk && !compressedPayloads[t].empty())
+            {
+                outFile.write(compressedPayloads[t].data(), compressedPayloads[t].size());
+            }
+            else if (chunk)
+            {
+                // Write the raw chunk data to the file
+                outFile.write(static_cast<const char*>(chunk->GetData()), entry.size);
+            }
+            else
+            {
+                // Chunks that are not in memory come from the current level file, or their chunk file if they never went into one
+                bool inLevelFile = entry.index < levelTable.size() && levelTable[entry.index].offset != 0;
+                std::ifstream chunkFile;
+                if (!inLevelFile)
+                {
+                    chunkFile.open(chunkFiles[entry.index], std::ios::binary);
+                }
+                const std::string& sourceName = inLevelFile ? levelFileName : chunkFiles[entry.index];
+
+                uint32_t checksum = 0;
+                if (!CopyFileRange(inLevelFile ? levelFile : chunkFile, inLevelFile ? levelTable[entry.index].offset : 0, entry.storedSize, outFile, checksum))
+                {
+                    LOG_ERROR("Error: Failed to copy chunk " << entry.index << " from " << sourceName);
+                    return false;
+                }
+                stats.bytesRead += entry.storedSize;
+
+                // Corruption in the old file is not carried over, payloads saved before checksums gain one
+                if ((entry.flags & LevelChunkFlag_Checksum) && checksum != entry.checksum)
+                {
+                    ++stats.corruptChunks;
+                    LOG_ERROR("Error: Chunk " << entry.index << " in " << sourceName << " is corrupt.");
+                    return false;
+                }
+                table[t].checksum = checksum;
+                table[t].flags |= LevelChunkFlag_Checksum;
+            }
+            LOG_DEBUG("Chunk " << entry.index << " saved successfully.");
+        }
+
+        // Rewrite the table now that every payload has its checksum
+        for (size_t t = 0; t < table.size(); ++t)
+        {
+            if (payloadOwner[t] != t)
+            {
+                table[t].flags = table[payloadOwner[t]].flags;
+                table[t].checksum = table[payloadOwner[t]].checksum;
+            }
+        }
+        std::streamoff fileBytes = outFile.tellp();
+        outFile.seekp(header.tableOffset, std::ios::beg);
+        outFile.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(LevelChunkEntry));
+
+        if (!outFile)
+        {
+            LOG_ERROR("Failed to write file: " << tempFileName);
+            return false;
+        }
+        stats.bytesWritten += static_cast<uint64_t>(fileBytes);
+    }
+
+    std::remove(fileName.c_str());
+    if (std::rename(tempFileName.c_str(), fileName.c_str()) != 0)
+    {
+        LOG_ERROR("Failed to replace file: " << fileName);
+        return false;
+    }
+
+    // The saved file now backs every chunk in the table
+    levelFileName = fileName;
+    levelTable.assign(chunkStatus.size(), LevelChunkEntry());
+    for (const auto& entry : table)
+    {
+        levelTable[entry.index] = entry;
+    }
+
+    LOG_INFO("Level saved successfully to " << fileName);
+    return true;
+}
+
+int Level::GetCurrentChunkIndex() const
+{
+    return currentChunkIndex;
+}
+
+// GetChunkStart: Returns the start position of a chunk in the image buffer
+void* Level::GetChunkStart(int chunkIndex)
+{
+    if (chunkIndex < 0 || static_cast<size_t>(chunkIndex) >= chunkOffsets.size())
+    {
+        LOG_ERROR("Invalid chunk index!");
+        return nullptr;
+    }
+
+    if (imageBuffer == nullptr)
+    {
+        return nullptr;
+    }
+
+    if (chunkOffsets[chunkIndex] + chunkSizes[chunkIndex] > totalSize)
+    {
+        LOG_ERROR("Chunk " << chunkIndex << " does not fit the image buffer.");
+        return nullptr;
+    }
+
+    return static_cast<char*>(imageBuffer) + chunkOffsets[chunkIndex];
+}
 
 // GetChunkSize: Returns the size of a specific chunk
 size_t Level::GetChunkSize(int chunkIndex)
 {
-    if (chunkIndex < 0 || chunkIndex >= chunkPointers.size())
+    if (chunkIndex < 0 || static_cast<size_t>(chunkIndex) >= chunkSizes.size())
     {
-        std::cerr << "Invalid chunk index!" << std::endl;
+        LOG_ERROR("Invalid chunk index!");
         return 0;
     }
 
-    return chunkPointers[chunkIndex]->GetSize();
+    return chunkSizes[chunkIndex];
+}
+
+size_t Level::GetChunkCount() const
+{
+    return chunkStatus.size();
+}
+
+// Image size needed to hold every chunk slot
+size_t Level::GetRequiredImageSize() const
+{
+    return chunkOffsets.empty() ? 0 : chunkOffsets.back() + chunkSizes.back();
+}
+
+// Lays out one slot per chunk file, in manifest order
+void Level::SetChunkManifest(const std::vector<std::string>& chunkFiles, ObjectPool<FileChunk>& fileChunkPool)
+{
+    TableUpdate update(*this);
+    // Chunks of the previous manifest go back to the pool, their slots and any level file no longer apply
+    ReleaseChunks(fileChunkPool);
+    chunkStatus.clear();
+    chunkPointers.clear();
+    chunkBlobs.clear();
+    levelTable.clear();
+    levelFileName.clear();
+    lastAccessIndex = -2;
+    if (prefetcher)
+    {
+        prefetcher->Clear();
+    }
+
+    // The slots are laid out from these sizes, so files that changed since they were cataloged are re-statted first
+    ResizeChunkTable(chunkFiles.size());
+    this->chunkFiles = chunkFiles;
+    ChunkCatalog::Instance().Refresh(chunkFiles);
+    chunkSizes = CalculateChunkSizes(chunkFiles);
+    RebuildChunkOffsets(0);
+}
+
+// Reads a manifest with one chunk file path per line (blank lines and lines starting with # are skipped)
+bool Level::ReadChunkManifest(const std::string& manifestPath, std::vector<std::string>& chunkFiles)
+{
+    std::ifstream manifest(manifestPath);
+    if (!manifest)
+    {
+        LOG_ERROR("Failed to open manifest: " << manifestPath);
+        return false;
+    }
+
+    chunkFiles.clear();
+    std::string line;
+    while (std::getline(manifest, line))
+    {
+        // Trim trailing whitespace and Windows line endings
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        chunkFiles.push_back(line);
+    }
+    return true;
+}
+
+// Returns every FileChunk owned by the level to the pool
+void Level::ReleaseChunks(ObjectPool<FileChunk>& fileChunkPool)
+{
+    journal.Clear();
+    for (auto& chunk : chunkPointers)
+    {
+        // Chunks handed in through AddChunkForTest do not come from the pool
+        if (chunk && fileChunkPool.Owns(chunk))
+        {
+            fileChunkPool.Release(chunk);
+        }
+        chunk = nullptr;
+    }
+    chunkMappings.clear();
+    chunkBlobs.assign(chunkBlobs.size(), nullptr);
+    residency.Clear();
+}
+
+// Grows or shrinks every per-chunk table, new chunks start empty and unloaded
+void Level::ResizeChunkTable(size_t chunkCount)
+{
+    chunkStatus.resize(chunkCount, false);
+    chunkPointers.resize(chunkCount, nullptr);
+    chunkSizes.resize(chunkCount, 0);
+    chunkOffsets.resize(chunkCount, 0);
+    chunkBlobs.resize(chunkCount);
+    residency.Resize(chunkCount);
+    evictedChecksums.resize(chunkCount, 0);
+    if (chunkFiles.size() < chunkCount)
+    {
+        chunkFiles.resize(chunkCount);
+    }
+}
+
+// Recomputes slot offsets from the chunk sizes, starting at fromIndex
+void Level::RebuildChunkOffsets(size_t fromIndex)
+{
+    size_t offset = fromIndex > 0 && fromIndex <= chunkSizes.size() ? chunkOffsets[fromIndex - 1] + chunkSizes[fromIndex - 1] : 0;
+    for (size_t i = fromIndex; i < chunkSizes.size(); ++i)
+    {
+        chunkOffsets[i] = offset;
+        offset += chunkSizes[i];
+    }
 }
 
 // IsChunkLoaded: Checks if the chunk at the given index is loaded
@@ -379,7 +2095,7 @@ bool Level::IsChunkLoaded(int chunkIndex) const
 {
     if (chunkIndex < 0 || chunkIndex >= chunkStatus.size())
     {
-        std::cerr << "Invalid chunk index!" << std::endl;
+        LOG_ERROR("Invalid chunk index!");
         return false;
     }
     return chunkStatus[chunkIndex];
@@ -388,14 +2104,16 @@ bool Level::IsChunkLoaded(int chunkIndex) const
 // Add a chunk for testing purposes
 void Level::AddChunkForTest(int chunkIndex, FileChunk* chunk)
 {
+    TableUpdate update(*this);
     if (chunkIndex >= chunkPointers.size())
     {
-        chunkPointers.resize(chunkIndex + 1, nullptr);
-        chunkStatus.resize(chunkIndex + 1, false);
+        ResizeChunkTable(chunkIndex + 1);
     }
 
     chunkPointers[chunkIndex] = chunk;
+    chunkSizes[chunkIndex] = chunk->GetSize();
     chunkStatus[chunkIndex] = true;  // Mark the chunk as loaded
+    RebuildChunkOffsets(chunkIndex);
 }
 
 void Level::TestIsChunkLoaded()
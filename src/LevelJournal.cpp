@@ -0,0 +1,297 @@
+#include "LevelJournal.h"
+#include "Logger.h"
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+// Default in-memory budget for chunk copies
+static const size_t DefaultJournalMemoryCap = 256 * 1024 * 1024;
+
+LevelJournal::LevelJournal()
+    : memoryCap(DefaultJournalMemoryCap), memoryUsed(0), spillFileName("undo.spill"), spillEnd(0)
+{
+}
+
+LevelJournal::~LevelJournal()
+{
+    Clear();
+}
+
+void LevelJournal::SetMemoryCap(size_t bytes)
+{
+    memoryCap = bytes;
+}
+
+void LevelJournal::SetSpillFile(const std::string& fileName)
+{
+    if (spillFile.is_open())
+    {
+        LOG_ERROR("Spill file is in use, it can only be changed while the journal is empty.");
+        return;
+    }
+    spillFileName = fileName;
+}
+
+LevelJournal::Command& LevelJournal::Push(LevelCommandType type, int chunkIndex)
+{
+    ClearCommands(redoCommands);
+
+    Command command;
+    command.type = type;
+    command.chunkIndex = chunkIndex;
+    command.storage = PayloadStorage::None;
+    command.size = 0;
+    command.reference = nullptr;
+    command.spillOffset = 0;
+    undoCommands.push_back(std::move(command));
+    return undoCommands.back();
+}
+
+void LevelJournal::Discard()
+{
+    if (!undoCommands.empty())
+    {
+        DropPayload(undoCommands.back());
+        undoCommands.pop_back();
+    }
+}
+
+LevelJournal::Command* LevelJournal::Undo()
+{
+    if (undoCommands.empty())
+    {
+        return nullptr;
+    }
+
+    redoCommands.push_back(std::move(undoCommands.back()));
+    undoCommands.pop_back();
+    return &redoCommands.back();
+}
+
+LevelJournal::Command* LevelJournal::Redo()
+{
+    if (redoCommands.empty())
+    {
+        return nullptr;
+    }
+
+    undoCommands.push_back(std::move(redoCommands.back()));
+    redoCommands.pop_back();
+    return &undoCommands.back();
+}
+
+void LevelJournal::KeepReference(Command& command, const void* data, size_t size, std::shared_ptr<const void> owner)
+{
+    DropPayload(command);
+    command.storage = PayloadStorage::Reference;
+    command.reference = data;
+    command.owner = std::move(owner);
+    command.size = size;
+}
+
+bool LevelJournal::KeepCopy(Command& command, const void* data, size_t size)
+{
+    // Copy before dropping, data may be the command's own payload
+    if (memoryUsed + size <= memoryCap)
+    {
+        std::vector<char> copy(static_cast<const char*>(data), static_cast<const char*>(data) + size);
+        DropPayload(command);
+        command.copy.swap(copy);
+        command.storage = PayloadStorage::Copy;
+        command.size = size;
+        memoryUsed += size;
+        return true;
+    }
+
+    if (!spillFile.is_open())
+    {
+        spillFile.open(spillFileName, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+        spillEnd = 0;
+        spillFreeRanges.clear();
+    }
+
+    uint64_t spillOffset = AllocateSpill(size);
+    spillFile.seekp(spillOffset, std::ios::beg);
+    spillFile.write(static_cast<const char*>(data), size);
+    if (!spillFile)
+    {
+        LOG_ERROR("Failed to spill chunk " << command.chunkIndex << " to " << spillFileName);
+        spillFile.clear();
+        FreeSpill(spillOffset, size);
+        return false;
+    }
+
+    DropPayload(command);
+    command.storage = PayloadStorage::Spilled;
+    command.spillOffset = spillOffset;
+    command.size = size;
+    return true;
+}
+
+bool LevelJournal::ReadPayload(const Command& command, void* destination)
+{
+    switch (command.storage)
+    {
+    case PayloadStorage::Reference:
+        memcpy(destination, command.reference, command.size);
+        return true;
+    case PayloadStorage::Copy:
+        memcpy(destination, command.copy.data(), command.size);
+        return true;
+    case PayloadStorage::Spilled:
+        spillFile.seekg(command.spillOffset, std::ios::beg);
+        if (!spillFile.read(static_cast<char*>(destination), command.size))
+        {
+            LOG_ERROR("Failed to read chunk " << command.chunkIndex << " back from " << spillFileName);
+            spillFile.clear();
+            return false;
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+void LevelJournal::Detach(const void* data)
+{
+    for (auto* commands : { &undoCommands, &redoCommands })
+    {
+        for (Command& command : *commands)
+        {
+            if (command.storage == PayloadStorage::Reference && command.reference == data && !command.owner)
+            {
+                KeepCopy(command, data, command.size);
+            }
+        }
+    }
+}
+
+void LevelJournal::Clear()
+{
+    ClearCommands(undoCommands);
+    ClearCommands(redoCommands);
+}
+
+size_t LevelJournal::GetUndoDepth() const
+{
+    return undoCommands.size();
+}
+
+size_t LevelJournal::GetRedoDepth() const
+{
+    return redoCommands.size();
+}
+
+size_t LevelJournal::GetMemoryUsed() const
+{
+    return memoryUsed;
+}
+
+uint64_t LevelJournal::GetSpillSize() const
+{
+    return spillEnd;
+}
+
+void LevelJournal::DropPayload(Command& command)
+{
+    if (command.storage == PayloadStorage::Copy)
+    {
+        memoryUsed -= command.size;
+        std::vector<char>().swap(command.copy);
+    }
+    else if (command.storage == PayloadStorage::Spilled)
+    {
+        FreeSpill(command.spillOffset, command.size);
+        command.spillOffset = 0;
+    }
+    command.storage = PayloadStorage::None;
+    command.reference = nullptr;
+    command.owner.reset();
+}
+
+void LevelJournal::ClearCommands(std::vector<Command>& commands)
+{
+    for (Command& command : commands)
+    {
+        DropPayload(command);
+    }
+    commands.clear();
+
+    // The spill file goes away with the last command
+    if (undoCommands.empty() && redoCommands.empty() && spillFile.is_open())
+    {
+        spillFile.close();
+        std::remove(spillFileName.c_str());
+        spillEnd = 0;
+        spillFreeRanges.clear();
+    }
+}
+
+uint64_t LevelJournal::AllocateSpill(size_t size)
+{
+    // First fit, chunk copies tend to be of similar sizes
+    for (auto range = spillFreeRanges.begin(); range != spillFreeRanges.end(); ++range)
+    {
+        if (range->second >= size)
+        {
+            uint64_t offset = range->first;
+            uint64_t rest = range->second - size;
+            spillFreeRanges.erase(range);
+            if (rest > 0)
+            {
+                spillFreeRanges.emplace(offset + size, rest);
+            }
+            return offset;
+        }
+    }
+
+    uint64_t offset = spillEnd;
+    spillEnd += size;
+    return offset;
+}
+
+void LevelJournal::FreeSpill(uint64_t offset, uint64_t size)
+{
+    if (size == 0)
+    {
+        return;
+    }
+
+    // Merge with the free ranges on either side
+    auto next = spillFreeRanges.lower_bound(offset);
+    if (next != spillFreeRanges.end() && next->first == offset + size)
+    {
+        size += next->second;
+        next = spillFreeRanges.erase(next);
+    }
+    if (next != spillFreeRanges.begin())
+    {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset)
+        {
+            offset = previous->first;
+            size += previous->second;
+            spillFreeRanges.erase(previous);
+        }
+    }
+
+    if (offset + size != spillEnd)
+    {
+        spillFreeRanges.emplace(offset, size);
+        return;
+    }
+
+    // The tail of the file is unused, give it back
+    spillEnd = offset;
+    spillFile.flush();
+#ifndef _WIN32
+    if (truncate(spillFileName.c_str(), static_cast<off_t>(spillEnd)) != 0)
+    {
+        LOG_WARNING("Failed to shrink " << spillFileName);
+    }
+#endif
+}
@@ -0,0 +1,145 @@
+#include "Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+    // The drain thread backs off while the ring stays empty, and is back to the short interval after a batch
+    const auto MinDrainInterval = std::chrono::milliseconds(1);
+    const auto MaxDrainInterval = std::chrono::milliseconds(32);
+
+    void WriteLine(LogLevel level, const char* text, size_t length)
+    {
+        std::ostream& out = level >= LogLevel::Warning ? std::cerr : std::cout;
+        out.write(text, length);
+        out.put('\n');
+    }
+}
+
+Logger& Logger::Instance()
+{
+    // Destroyed at exit, which drains whatever is still queued
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger()
+    : ring(new Entry[RingCapacity]), enqueuePosition(0), flushedPosition(0), minLevel(static_cast<int>(LogLevel::Info)), stopping(false)
+{
+    // An entry is free for the write at position p when its sequence is p, and readable when it is p + 1
+    for (size_t i = 0; i < RingCapacity; ++i)
+    {
+        ring[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    drainThread = std::thread(&Logger::Drain, this);
+}
+
+Logger::~Logger()
+{
+    stopping.store(true, std::memory_order_release);
+    drainThread.join();
+}
+
+void Logger::Write(LogLevel level, const std::string& message)
+{
+    size_t length = message.size() < MaxMessageSize ? message.size() : MaxMessageSize;
+
+    // Nothing drains the ring any more
+    if (stopping.load(std::memory_order_acquire))
+    {
+        WriteLine(level, message.data(), length);
+        return;
+    }
+
+    // Claim a position, several threads may race for it
+    Entry* entry;
+    size_t position = enqueuePosition.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        entry = &ring[position & (RingCapacity - 1)];
+        size_t sequence = entry->sequence.load(std::memory_order_acquire);
+        if (sequence == position)
+        {
+            if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (sequence < position)
+        {
+            // The ring is full, wait for the drain thread to catch up
+            std::this_thread::yield();
+            position = enqueuePosition.load(std::memory_order_relaxed);
+        }
+        else
+        {
+            position = enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    entry->level = level;
+    entry->length = static_cast<uint32_t>(length);
+    memcpy(entry->text, message.data(), length);
+    entry->sequence.store(position + 1, std::memory_order_release);
+}
+
+void Logger::Flush()
+{
+    size_t target = enqueuePosition.load(std::memory_order_acquire);
+    while (flushedPosition.load(std::memory_order_acquire) < target && !stopping.load(std::memory_order_acquire))
+    {
+        std::this_thread::sleep_for(MinDrainInterval);
+    }
+}
+
+void Logger::SetLevel(LogLevel level)
+{
+    minLevel.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+bool Logger::IsEnabled(LogLevel level) const
+{
+    return static_cast<int>(level) >= minLevel.load(std::memory_order_relaxed);
+}
+
+void Logger::Drain()
+{
+    size_t position = 0;
+    std::chrono::milliseconds interval = MinDrainInterval;
+    for (;;)
+    {
+        // Write every published message, then flush the streams once for the whole batch
+        size_t batchStart = position;
+        for (;;)
+        {
+            Entry& entry = ring[position & (RingCapacity - 1)];
+            if (entry.sequence.load(std::memory_order_acquire) != position + 1)
+            {
+                break;
+            }
+
+            WriteLine(entry.level, entry.text, entry.length);
+            entry.sequence.store(position + RingCapacity, std::memory_order_release);
+            ++position;
+        }
+
+        if (position != batchStart)
+        {
+            std::cout.flush();
+            std::cerr.flush();
+            flushedPosition.store(position, std::memory_order_release);
+            interval = MinDrainInterval;
+            continue;
+        }
+
+        // Producers are done by the time the logger is destroyed, so an empty ring stays empty
+        if (stopping.load(std::memory_order_acquire))
+        {
+            break;
+        }
+        std::this_thread::sleep_for(interval);
+        interval = std::min(interval * 2, MaxDrainInterval);
+    }
+}
@@ -0,0 +1,240 @@
+#include "Metrics.h"
+#include <cmath>
+#include <iomanip>
+
+JsonWriter& JsonWriter::BeginObject()
+{
+    BeginElement();
+    out << '{';
+    hasElements.push_back(false);
+    return *this;
+}
+
+JsonWriter& JsonWriter::EndObject()
+{
+    out << '}';
+    hasElements.pop_back();
+    return *this;
+}
+
+JsonWriter& JsonWriter::BeginArray()
+{
+    BeginElement();
+    out << '[';
+    hasElements.push_back(false);
+    return *this;
+}
+
+JsonWriter& JsonWriter::EndArray()
+{
+    out << ']';
+    hasElements.pop_back();
+    return *this;
+}
+
+JsonWriter& JsonWriter::Key(const std::string& name)
+{
+    Value(name);
+    out << ':';
+    afterKey = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::Value(const std::string& value)
+{
+    BeginElement();
+    out << '"';
+    for (char c : value)
+    {
+        switch (c)
+        {
+        case '"': out << "\\\""; break;
+        case '\\': out << "\\\\"; break;
+        case '\n': out << "\\n"; break;
+        case '\r': out << "\\r"; break;
+        case '\t': out << "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec << std::setfill(' ');
+            }
+            else
+            {
+                out << c;
+            }
+            break;
+        }
+    }
+    out << '"';
+    return *this;
+}
+
+JsonWriter& JsonWriter::Value(const char* value)
+{
+    return Value(std::string(value ? value : ""));
+}
+
+JsonWriter& JsonWriter::Value(bool value)
+{
+    BeginElement();
+    out << (value ? "true" : "false");
+    return *this;
+}
+
+JsonWriter& JsonWriter::Value(int value)
+{
+    return Value(static_cast<long long>(value));
+}
+
+JsonWriter& JsonWriter::Value(long value)
+{
+    return Value(static_cast<long long>(value));
+}
+
+JsonWriter& JsonWriter::Value(long long value)
+{
+    BeginElement();
+    out << value;
+    return *this;
+}
+
+JsonWriter& JsonWriter::Value(unsigned int value)
+{
+    return Value(static_cast<unsigned long long>(value));
+}
+
+JsonWriter& JsonWriter::Value(unsigned long value)
+{
+    return Value(static_cast<unsigned long long>(value));
+}
+
+JsonWriter& JsonWriter::Value(unsigned long long value)
+{
+    BeginElement();
+    out << value;
+    return *this;
+}
+
+JsonWriter& JsonWriter::Value(double value)
+{
+    BeginElement();
+    // JSON has no NaN or infinity
+    if (std::isfinite(value))
+    {
+        out << value;
+    }
+    else
+    {
+        out << "null";
+    }
+    return *this;
+}
+
+std::string JsonWriter::ToString() const
+{
+    return out.str();
+}
+
+void JsonWriter::BeginElement()
+{
+    if (afterKey)
+    {
+        // The key already placed the comma
+        afterKey = false;
+        return;
+    }
+    if (!hasElements.empty())
+    {
+        if (hasElements.back())
+        {
+            out << ',';
+        }
+        hasElements.back() = true;
+    }
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+    Reset();
+}
+
+void LatencyHistogram::Record(uint64_t nanoseconds)
+{
+    int bucket = 0;
+    for (uint64_t value = nanoseconds; value > 1 && bucket < BucketCount - 1; value >>= 1)
+    {
+        ++bucket;
+    }
+
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    totalNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+    uint64_t previousMax = maxNanoseconds.load(std::memory_order_relaxed);
+    while (nanoseconds > previousMax && !maxNanoseconds.compare_exchange_weak(previousMax, nanoseconds, std::memory_order_relaxed))
+    {
+    }
+}
+
+void LatencyHistogram::Reset()
+{
+    for (auto& bucket : buckets)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+    totalNanoseconds.store(0, std::memory_order_relaxed);
+    maxNanoseconds.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetCount() const
+{
+    return count.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetTotalNanoseconds() const
+{
+    return totalNanoseconds.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetMaxNanoseconds() const
+{
+    return maxNanoseconds.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetPercentileNanoseconds(double percentile) const
+{
+    uint64_t total = GetCount();
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    uint64_t rank = static_cast<uint64_t>(std::ceil(percentile / 100.0 * total));
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < BucketCount; ++bucket)
+    {
+        seen += buckets[bucket].load(std::memory_order_relaxed);
+        if (seen >= rank && seen > 0)
+        {
+            // The bucket's upper bound, never above the largest sample
+            uint64_t upper = bucket + 1 < 64 ? (uint64_t(1) << (bucket + 1)) - 1 : UINT64_MAX;
+            return upper < GetMaxNanoseconds() ? upper : GetMaxNanoseconds();
+        }
+    }
+    return GetMaxNanoseconds();
+}
+
+void LatencyHistogram::WriteJson(JsonWriter& json) const
+{
+    uint64_t samples = GetCount();
+    json.BeginObject();
+    json.Key("count").Value(static_cast<unsigned long long>(samples));
+    json.Key("totalUs").Value(GetTotalNanoseconds() / 1000.0);
+    json.Key("meanUs").Value(samples ? GetTotalNanoseconds() / 1000.0 / samples : 0.0);
+    json.Key("p50Us").Value(GetPercentileNanoseconds(50) / 1000.0);
+    json.Key("p90Us").Value(GetPercentileNanoseconds(90) / 1000.0);
+    json.Key("p99Us").Value(GetPercentileNanoseconds(99) / 1000.0);
+    json.Key("maxUs").Value(GetMaxNanoseconds() / 1000.0);
+    json.EndObject();
+}
@@ -1,8 +1,11 @@
 #include "SDLManager.h"
-#include <iostream>
+#include "TgaImage.h"
+#include "Logger.h"
+#include <algorithm>
+#include <climits>
 
 // Constructor
-SDLManager::SDLManager() : window(nullptr), renderer(nullptr), texture(nullptr) {}
+SDLManager::SDLManager() : window(nullptr), renderer(nullptr), texture(nullptr), flip(SDL_FLIP_NONE), rawTexture(false), imageSize(0), librariesReady(false) {}
 
 // Destructor
 SDLManager::~SDLManager()
@@ -13,37 +16,216 @@ SDLManager::~SDLManager()
 // Initialize SDL, create the window and renderer, and load the image
 bool SDLManager::Init(const std::string& windowTitle, int width, int height, const std::string& imagePath)
 {
+    ReleaseImage();
+    if (!InitLibraries())
+    {
+        return false;
+    }
+
+    // Load the image
+    SDL_Surface* imageSurface = IMG_Load(imagePath.c_str());
+    if (!imageSurface)
+    {
+        LOG_ERROR("IMG_Load Error: " << IMG_GetError());
+        return false;
+    }
+
+    if (!CreateWindowAndRenderer(windowTitle, imageSurface->w, imageSurface->h))
+    {
+        SDL_FreeSurface(imageSurface);
+        return false;
+    }
+    if (!CreateTextureFromSurface(imageSurface))
+    {
+        return false;
+    }
+    SDL_RaiseWindow(window);
+
+    return true;
+}
+
+// Initialize SDL and build the texture from a TGA image in memory
+bool SDLManager::Init(const std::string& windowTitle, int width, int height, const void* imageData, size_t imageSize)
+{
+    ReleaseImage();
+    if (!InitLibraries())
+    {
+        return false;
+    }
+
+    if (!TgaImage::Parse(imageData, imageSize, image))
+    {
+        LOG_ERROR("The image buffer does not hold a complete TGA image.");
+        return false;
+    }
+
+    if (image.format == TgaImage::PixelFormat::Bgr24 || image.format == TgaImage::PixelFormat::Bgra32 || image.format == TgaImage::PixelFormat::Argb1555)
+    {
+        if (!CreateWindowAndRenderer(windowTitle, image.width, image.height) || !CreateTextureFromPixels(image, imageData))
+        {
+            return false;
+        }
+        rawTexture = true;
+        this->imageSize = imageSize;
+    }
+    else
+    {
+        // Compressed, color-mapped and grayscale images go through SDL_image, still without a file
+        SDL_RWops* stream = imageSize <= static_cast<size_t>(INT_MAX) ? SDL_RWFromConstMem(imageData, static_cast<int>(imageSize)) : nullptr;
+        SDL_Surface* imageSurface = stream ? IMG_LoadTGA_RW(stream) : nullptr;
+        if (stream)
+        {
+            SDL_RWclose(stream);
+        }
+        if (!imageSurface)
+        {
+            LOG_ERROR("IMG_LoadTGA_RW Error: " << IMG_GetError());
+            return false;
+        }
+
+        if (!CreateWindowAndRenderer(windowTitle, imageSurface->w, imageSurface->h))
+        {
+            SDL_FreeSurface(imageSurface);
+            return false;
+        }
+        if (!CreateTextureFromSurface(imageSurface))
+        {
+            return false;
+        }
+    }
+    SDL_RaiseWindow(window);
+
+    return true;
+}
+
+// Patches the texture row span of every changed byte range, neighbouring spans are uploaded together
+bool SDLManager::UpdateImage(const void* imageData, size_t imageSize, const DirtyRangeSet& changes)
+{
+    if (!texture || !rawTexture || imageSize != this->imageSize)
+    {
+        return false;
+    }
+
+    uint32_t spanStart = 0;
+    uint32_t spanEnd = 0;  // One past the last row of the pending span
+    for (const auto& range : changes.GetRanges())
+    {
+        // The header decides the layout, the texture cannot follow a change to it
+        if (range.begin < image.pixelOffset)
+        {
+            return false;
+        }
+
+        uint32_t firstRow;
+        uint32_t rowCount;
+        if (!image.GetStoredRows(range.begin, range.end, firstRow, rowCount))
+        {
+            continue;
+        }
+
+        // Ranges are sorted, so a range either extends the pending span or starts a new one
+        if (spanEnd > spanStart && firstRow <= spanEnd)
+        {
+            spanEnd = std::max(spanEnd, firstRow + rowCount);
+            continue;
+        }
+        if (spanEnd > spanStart && !UpdateRows(imageData, spanStart, spanEnd - spanStart))
+        {
+            return false;
+        }
+        spanStart = firstRow;
+        spanEnd = firstRow + rowCount;
+    }
+    return spanEnd == spanStart || UpdateRows(imageData, spanStart, spanEnd - spanStart);
+}
+
+bool SDLManager::UpdateRows(const void* imageData, uint32_t firstRow, uint32_t rowCount)
+{
+    // Texture rows are in stored order, the same rows of the file
+    SDL_Rect rows = { 0, static_cast<int>(firstRow), static_cast<int>(image.width), static_cast<int>(rowCount) };
+    const char* pixels = static_cast<const char*>(imageData) + image.pixelOffset + firstRow * image.pitch;
+    if (SDL_UpdateTexture(texture, &rows, pixels, static_cast<int>(image.pitch)) != 0)
+    {
+        LOG_ERROR("SDL_UpdateTexture Error: " << SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+void SDLManager::Hide()
+{
+    if (window)
+    {
+        SDL_HideWindow(window);
+    }
+}
+
+void SDLManager::Show()
+{
+    if (window)
+    {
+        SDL_ShowWindow(window);
+        SDL_RaiseWindow(window);
+    }
+}
+
+bool SDLManager::IsInitialized() const
+{
+    return texture != nullptr;
+}
+
+void SDLManager::ReleaseImage()
+{
+    if (texture)
+    {
+        SDL_DestroyTexture(texture);
+        texture = nullptr;
+    }
+    flip = SDL_FLIP_NONE;
+    rawTexture = false;
+    imageSize = 0;
+}
+
+bool SDLManager::InitLibraries()
+{
+    // SDL stays up between images, only Cleanup shuts it down
+    if (librariesReady)
+    {
+        return true;
+    }
+
     if (SDL_Init(SDL_INIT_VIDEO) != 0)
     {
-        std::cerr << "SDL_Init Error: " << SDL_GetError() << std::endl;
+        LOG_ERROR("SDL_Init Error: " << SDL_GetError());
         return false;
     }
 
     if (IMG_Init(IMG_INIT_TIF) == -1)
     {
-        std::cerr << "IMG_Init Error: " << IMG_GetError() << std::endl;
+        LOG_ERROR("IMG_Init Error: " << IMG_GetError());
         SDL_Quit();
         return false;
     }
+    librariesReady = true;
+    return true;
+}
 
-    // Load the image
-    SDL_Surface* imageSurface = IMG_Load(imagePath.c_str());
-    if (!imageSurface)
+bool SDLManager::CreateWindowAndRenderer(const std::string& windowTitle, int width, int height)
+{
+    // A window from an earlier image is resized and reused along with its renderer
+    if (window && renderer)
     {
-        std::cerr << "IMG_Load Error: " << IMG_GetError() << std::endl;
-        IMG_Quit();
-        SDL_Quit();
-        return false;
+        SDL_SetWindowTitle(window, windowTitle.c_str());
+        SDL_SetWindowSize(window, width, height);
+        return true;
     }
 
     // Create a window
-    window = SDL_CreateWindow(windowTitle.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, imageSurface->w, imageSurface->h, SDL_WINDOW_RESIZABLE);
+    window = SDL_CreateWindow(windowTitle.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, SDL_WINDOW_RESIZABLE);
     if (!window)
     {
-        std::cerr << "SDL_CreateWindow Error: " << SDL_GetError() << std::endl;
-        SDL_FreeSurface(imageSurface);
-        IMG_Quit();
-        SDL_Quit();
+        LOG_ERROR("SDL_CreateWindow Error: " << SDL_GetError());
+        Cleanup();
         return false;
     }
 
@@ -51,28 +233,65 @@ bool SDLManager::Init(const std::string& windowTitle, int width, int height, con
     renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
     if (!renderer)
     {
-        std::cerr << "SDL_CreateRenderer Error: " << SDL_GetError() << std::endl;
-        SDL_FreeSurface(imageSurface);
-        SDL_DestroyWindow(window);
-        IMG_Quit();
-        SDL_Quit();
+        // No GPU, or the offscreen dummy video driver
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+    }
+    if (!renderer)
+    {
+        LOG_ERROR("SDL_CreateRenderer Error: " << SDL_GetError());
+        Cleanup();
         return false;
     }
+    return true;
+}
 
-    // Create a texture from the image surface
-    texture = SDL_CreateTextureFromSurface(renderer, imageSurface);
-    SDL_FreeSurface(imageSurface);
+bool SDLManager::CreateTextureFromSurface(SDL_Surface* surface)
+{
+    // Decoders already put the rows in display order
+    texture = SDL_CreateTextureFromSurface(renderer, surface);
+    SDL_FreeSurface(surface);
+    flip = SDL_FLIP_NONE;
     if (!texture)
     {
-        std::cerr << "SDL_CreateTextureFromSurface Error: " << SDL_GetError() << std::endl;
-        SDL_DestroyRenderer(renderer);
-        SDL_DestroyWindow(window);
-        IMG_Quit();
-        SDL_Quit();
+        LOG_ERROR("SDL_CreateTextureFromSurface Error: " << SDL_GetError());
+        ReleaseImage();
         return false;
     }
-    SDL_RaiseWindow(window);
+    return true;
+}
 
+bool SDLManager::CreateTextureFromPixels(const TgaImage& image, const void* imageData)
+{
+    Uint32 format = SDL_PIXELFORMAT_ARGB1555;
+    if (image.format == TgaImage::PixelFormat::Bgr24)
+    {
+        format = SDL_PIXELFORMAT_BGR24;
+    }
+    else if (image.format == TgaImage::PixelFormat::Bgra32)
+    {
+        format = SDL_PIXELFORMAT_BGRA32;
+    }
+
+    // The pixels are uploaded in stored order, rendering flips them into place
+    texture = SDL_CreateTexture(renderer, format, SDL_TEXTUREACCESS_STREAMING, image.width, image.height);
+    const char* pixels = static_cast<const char*>(imageData) + image.pixelOffset;
+    if (!texture || SDL_UpdateTexture(texture, nullptr, pixels, static_cast<int>(image.pitch)) != 0)
+    {
+        LOG_ERROR("SDL_CreateTexture Error: " << SDL_GetError());
+        ReleaseImage();
+        return false;
+    }
+
+    int flags = SDL_FLIP_NONE;
+    if (image.bottomUp)
+    {
+        flags |= SDL_FLIP_VERTICAL;
+    }
+    if (image.rightToLeft)
+    {
+        flags |= SDL_FLIP_HORIZONTAL;
+    }
+    flip = static_cast<SDL_RendererFlip>(flags);
     return true;
 }
 
@@ -122,18 +341,14 @@ void SDLManager::HandleImageViewEvents(bool& viewImage)
 void SDLManager::Render()
 {
     SDL_RenderClear(renderer);
-    SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+    SDL_RenderCopyEx(renderer, texture, nullptr, nullptr, 0.0, nullptr, flip);
     SDL_RenderPresent(renderer);
 }
 
 // Clean up SDL resources
 void SDLManager::Cleanup()
 {
-    if (texture)
-    {
-        SDL_DestroyTexture(texture);
-        texture = nullptr;
-    }
+    ReleaseImage();
 
     if (renderer)
     {
@@ -147,7 +362,11 @@ void SDLManager::Cleanup()
         window = nullptr;
     }
 
-    IMG_Quit();
-    SDL_Quit();
+    if (librariesReady)
+    {
+        IMG_Quit();
+        SDL_Quit();
+        librariesReady = false;
+    }
 }
 
@@ -1,35 +1,155 @@
 #include "StackAllocator.h"
+#include "Metrics.h"
 #include <cassert>
 #include <cstdlib>
+#include <cstdint>
 
-StackAllocator::StackAllocator(size_t totalSize)
+StackAllocator::StackAllocator(size_t totalSize, bool growable)
 {
-    _start = malloc(totalSize);
     _offset = 0;
-    _totalSize = totalSize;
+    _pageSize = totalSize;
+    _growable = growable;
+    _allocations = 0;
+    _failedAllocations = 0;
+    _highWaterMark = 0;
+    AddPage(totalSize);
 }
 
 StackAllocator::~StackAllocator()
 {
-    free(_start);
+    for (const Page& page : _pages)
+    {
+        free(page.start);
+    }
 }
 
-void* StackAllocator::Allocate(size_t size)
+void* StackAllocator::Allocate(size_t size, size_t alignment)
 {
-    assert(_offset + size <= _totalSize && "StackAllocator: Not enough memory.");
-    void* ptr = static_cast<unsigned char*>(_start) + _offset;
-    _offset += size;
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0 && "StackAllocator: Alignment must be a power of two.");
+    if (_pages.empty())
+    {
+        ++_failedAllocations;
+        return nullptr;
+    }
+
+    // Align the address, not the offset, pages are only malloc-aligned
+    const Page* page = &_pages.back();
+    uintptr_t address = reinterpret_cast<uintptr_t>(page->start) + _offset;
+    size_t padding = (alignment - (address & (alignment - 1))) & (alignment - 1);
+
+    if (size > page->size - _offset || padding > page->size - _offset - size)
+    {
+        // Chain a page large enough for the allocation at any alignment
+        if (!_growable || size > SIZE_MAX - alignment || !AddPage(size + alignment))
+        {
+            ++_failedAllocations;
+            return nullptr;
+        }
+
+        page = &_pages.back();
+        address = reinterpret_cast<uintptr_t>(page->start);
+        padding = (alignment - (address & (alignment - 1))) & (alignment - 1);
+    }
+
+    void* ptr = page->start + _offset + padding;
+    _offset += padding + size;
+    ++_allocations;
+    if (GetMarker() > _highWaterMark)
+    {
+        _highWaterMark = GetMarker();
+    }
     return ptr;
 }
 
-
 void StackAllocator::FreeToMarker(size_t marker)
 {
-    assert(marker <= _offset && "StackAllocator: Invalid marker.");
-    _offset = marker;
+    assert(marker <= GetMarker() && "StackAllocator: Invalid marker.");
+    if (marker > GetMarker())
+    {
+        return;
+    }
+
+    // Drop pages that start past the marker
+    while (_pages.size() > 1 && _pages.back().base > marker)
+    {
+        free(_pages.back().start);
+        _pages.pop_back();
+    }
+    _offset = marker - _pages.back().base;
 }
 
 size_t StackAllocator::GetMarker() const
 {
-    return _offset;
+    return _pages.empty() ? 0 : _pages.back().base + _offset;
+}
+
+size_t StackAllocator::GetCapacity() const
+{
+    return _pages.empty() ? 0 : _pages.back().base + _pages.back().size;
+}
+
+StackAllocator::Stats StackAllocator::GetStats() const
+{
+    Stats stats;
+    stats.allocations = _allocations;
+    stats.failedAllocations = _failedAllocations;
+    stats.bytesInUse = GetMarker();
+    stats.highWaterMark = _highWaterMark;
+    stats.pageCount = _pages.size();
+    stats.capacity = GetCapacity();
+    return stats;
+}
+
+void StackAllocator::ResetStats()
+{
+    _allocations = 0;
+    _failedAllocations = 0;
+    _highWaterMark = GetMarker();
+}
+
+void StackAllocator::WriteStatsJson(JsonWriter& json) const
+{
+    Stats stats = GetStats();
+    json.BeginObject();
+    json.Key("allocations").Value(stats.allocations);
+    json.Key("failedAllocations").Value(stats.failedAllocations);
+    json.Key("bytesInUse").Value(stats.bytesInUse);
+    json.Key("highWaterMark").Value(stats.highWaterMark);
+    json.Key("pageCount").Value(stats.pageCount);
+    json.Key("capacity").Value(stats.capacity);
+    json.EndObject();
+}
+
+bool StackAllocator::AddPage(size_t minSize)
+{
+    size_t size = minSize > _pageSize ? minSize : _pageSize;
+    unsigned char* start = static_cast<unsigned char*>(malloc(size > 0 ? size : 1));
+    if (!start)
+    {
+        return false;
+    }
+
+    // Markers keep counting across pages, the unused tail of the previous page is skipped
+    size_t base = _pages.empty() ? 0 : _pages.back().base + _pages.back().size;
+    _pages.push_back({ start, size, base });
+    _offset = 0;
+    return true;
+}
+
+StackAllocator::ScopedMarker::ScopedMarker(StackAllocator& allocator)
+    : _allocator(allocator), _marker(allocator.GetMarker()), _active(true)
+{
+}
+
+StackAllocator::ScopedMarker::~ScopedMarker()
+{
+    if (_active)
+    {
+        _allocator.FreeToMarker(_marker);
+    }
+}
+
+void StackAllocator::ScopedMarker::Dismiss()
+{
+    _active = false;
 }
@@ -0,0 +1,88 @@
+#include "TgaImage.h"
+
+namespace
+{
+    const size_t HeaderSize = 18;
+
+    // Image types of the header
+    const uint8_t TypeTrueColor = 2;
+    const uint8_t TypeGrayscale = 3;
+
+    uint16_t Read16(const unsigned char* bytes)
+    {
+        return static_cast<uint16_t>(bytes[0] | (bytes[1] << 8));
+    }
+}
+
+bool TgaImage::Parse(const void* data, size_t size, TgaImage& image)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    if (!bytes || size < HeaderSize)
+    {
+        return false;
+    }
+
+    uint8_t idLength = bytes[0];
+    uint8_t colorMapType = bytes[1];
+    uint8_t imageType = bytes[2];
+    uint16_t colorMapLength = Read16(bytes + 5);
+    uint8_t colorMapEntryBits = bytes[7];
+    uint8_t pixelDepth = bytes[16];
+    uint8_t descriptor = bytes[17];
+
+    image = TgaImage();
+    image.width = Read16(bytes + 12);
+    image.height = Read16(bytes + 14);
+    image.bytesPerPixel = (pixelDepth + 7) / 8;
+    image.pitch = static_cast<size_t>(image.width) * image.bytesPerPixel;
+    image.bottomUp = (descriptor & 0x20) == 0;
+    image.rightToLeft = (descriptor & 0x10) != 0;
+
+    // The pixels follow the image id and the color map
+    size_t colorMapSize = colorMapType ? static_cast<size_t>(colorMapLength) * ((colorMapEntryBits + 7) / 8) : 0;
+    image.pixelOffset = HeaderSize + idLength + colorMapSize;
+    if (image.pixelOffset > size)
+    {
+        return false;
+    }
+
+    // Only uncompressed pixels can be used in place, everything else is left to a full decoder
+    if (colorMapType == 0 && imageType == TypeTrueColor)
+    {
+        switch (pixelDepth)
+        {
+        case 15:
+        case 16: image.format = PixelFormat::Argb1555; break;
+        case 24: image.format = PixelFormat::Bgr24; break;
+        case 32: image.format = PixelFormat::Bgra32; break;
+        default: break;
+        }
+    }
+    else if (colorMapType == 0 && imageType == TypeGrayscale && pixelDepth == 8)
+    {
+        image.format = PixelFormat::Gray8;
+    }
+
+    // Raw pixels must all be there
+    if (image.IsRaw() && image.pitch * image.height > size - image.pixelOffset)
+    {
+        return false;
+    }
+    return true;
+}
+
+bool TgaImage::GetStoredRows(size_t begin, size_t end, uint32_t& firstRow, uint32_t& rowCount) const
+{
+    size_t pixelEnd = pixelOffset + pitch * height;
+    begin = begin > pixelOffset ? begin : pixelOffset;
+    end = end < pixelEnd ? end : pixelEnd;
+    if (begin >= end || pitch == 0)
+    {
+        return false;
+    }
+
+    firstRow = static_cast<uint32_t>((begin - pixelOffset) / pitch);
+    uint32_t lastRow = static_cast<uint32_t>((end - 1 - pixelOffset) / pitch);
+    rowCount = lastRow - firstRow + 1;
+    return true;
+}
@@ -0,0 +1,401 @@
+#include "TlsfAllocator.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Block header, the payload follows it. A free block's list links live in the header, every block knows the block
+// before it in memory so Free can merge both ways. Each pool ends with a zero-size used block that stops merging.
+struct alignas(16) TlsfAllocator::Block
+{
+    Block* previousPhysical;  // nullptr for the first block of a pool
+    size_t size;              // Payload bytes, FreeBit is set while the block is free
+    Block* nextFree;
+    Block* previousFree;
+};
+
+namespace
+{
+    const size_t FreeBit = 1;
+    const size_t BlockAlignment = 16;
+    const size_t MinBlockSize = 16;
+
+    size_t AlignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    // Index of the lowest set bit, value != 0
+    int FindFirstSet(uint32_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, value);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctz(value);
+#endif
+    }
+
+    // Index of the highest set bit, value != 0
+    int FindLastSet(uint64_t value)
+    {
+#if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return static_cast<int>(index);
+#elif defined(_MSC_VER)
+        unsigned long index;
+        if (value >> 32)
+        {
+            _BitScanReverse(&index, static_cast<unsigned long>(value >> 32));
+            return static_cast<int>(index) + 32;
+        }
+        _BitScanReverse(&index, static_cast<unsigned long>(value));
+        return static_cast<int>(index);
+#else
+        return 63 - __builtin_clzll(value);
+#endif
+    }
+}
+
+TlsfAllocator::TlsfAllocator(size_t poolSize, bool growable)
+    : firstLevelBitmap(0), poolSize(poolSize), growable(growable), capacity(0), allocations(0), frees(0), failedAllocations(0), bytesInUse(0), highWaterMark(0)
+{
+    memset(secondLevelBitmaps, 0, sizeof(secondLevelBitmaps));
+    memset(freeLists, 0, sizeof(freeLists));
+    if (poolSize > 0 && !AddPool(0))
+    {
+        LOG_ERROR("TlsfAllocator: Could not reserve " << poolSize << " bytes.");
+    }
+}
+
+TlsfAllocator::~TlsfAllocator()
+{
+    if (bytesInUse != 0)
+    {
+        LOG_WARNING("TlsfAllocator: Destroyed with " << bytesInUse << " bytes still allocated.");
+    }
+
+    for (void* pool : pools)
+    {
+        free(pool);
+    }
+}
+
+void* TlsfAllocator::Allocate(size_t size, size_t alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0 && "TlsfAllocator: Alignment must be a power of two.");
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Stronger alignments search for room to move the payload up, the skipped bytes become a free block
+    size_t gapRoom = alignment > BlockAlignment ? alignment + sizeof(Block) + MinBlockSize : 0;
+    if (size > (static_cast<size_t>(-1) >> 2) - gapRoom)
+    {
+        ++failedAllocations;
+        return nullptr;
+    }
+
+    size_t blockSize = AlignUp(std::max(size, MinBlockSize), BlockAlignment);
+    Block* block = FindFree(blockSize + gapRoom);
+    if (!block && growable && AddPool(blockSize + gapRoom))
+    {
+        block = FindFree(blockSize + gapRoom);
+    }
+    if (!block)
+    {
+        ++failedAllocations;
+        return nullptr;
+    }
+
+    if (gapRoom > 0)
+    {
+        uintptr_t payload = reinterpret_cast<uintptr_t>(block + 1);
+        uintptr_t aligned = AlignUp(payload, alignment);
+        if (aligned != payload && aligned - payload < sizeof(Block) + MinBlockSize)
+        {
+            aligned = AlignUp(payload + sizeof(Block) + MinBlockSize, alignment);
+        }
+        if (aligned != payload)
+        {
+            block = SplitFront(block, aligned - payload);
+        }
+    }
+    SplitBack(block, blockSize);
+
+    ++allocations;
+    bytesInUse += block->size;
+    highWaterMark = std::max(highWaterMark, bytesInUse);
+    return block + 1;
+}
+
+void TlsfAllocator::Free(void* memory)
+{
+    if (!memory)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Block* block = static_cast<Block*>(memory) - 1;
+    assert(!(block->size & FreeBit) && "TlsfAllocator: Block freed twice.");
+    ++frees;
+    bytesInUse -= block->size;
+
+    // Merge with the free neighbours so the space comes back as one block
+    Block* next = reinterpret_cast<Block*>(reinterpret_cast<char*>(block + 1) + block->size);
+    if (next->size & FreeBit)
+    {
+        RemoveFree(next);
+        block->size += sizeof(Block) + SizeOf(next);
+        next = reinterpret_cast<Block*>(reinterpret_cast<char*>(block + 1) + block->size);
+        next->previousPhysical = block;
+    }
+
+    Block* previous = block->previousPhysical;
+    if (previous && (previous->size & FreeBit))
+    {
+        RemoveFree(previous);
+        previous->size = SizeOf(previous) + sizeof(Block) + block->size;
+        next->previousPhysical = previous;
+        block = previous;
+    }
+
+    block->size |= FreeBit;
+    InsertFree(block);
+}
+
+ChunkAllocator::Stats TlsfAllocator::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats stats;
+    stats.allocations = allocations;
+    stats.frees = frees;
+    stats.failedAllocations = failedAllocations;
+    stats.bytesInUse = bytesInUse;
+    stats.highWaterMark = highWaterMark;
+    stats.capacity = capacity;
+    return stats;
+}
+
+void TlsfAllocator::WriteStatsJson(JsonWriter& json) const
+{
+    Stats stats = GetStats();
+    json.BeginObject();
+    json.Key("type").Value("tlsf");
+    WriteStatsFields(json, stats);
+    json.Key("pools").Value(GetPoolCount());
+    json.Key("largestFreeBlock").Value(GetLargestFreeBlock());
+    json.EndObject();
+}
+
+size_t TlsfAllocator::GetLargestFreeBlock() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return GetLargestFreeBlockLocked();
+}
+
+size_t TlsfAllocator::GetPoolCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pools.size();
+}
+
+bool TlsfAllocator::AddPool(size_t minSize)
+{
+    // Room for the first block's header, the end marker and aligning the start, and for the size class
+    // rounding in FindFree so a block of minSize bytes is found in the new pool
+    size_t overhead = 2 * sizeof(Block) + BlockAlignment;
+    size_t bytes = std::max(poolSize, minSize + (minSize >> SecondLevelLog2) + overhead);
+    int firstLevel, secondLevel;
+    if (bytes < overhead + MinBlockSize || !MapInsert(bytes, firstLevel, secondLevel))
+    {
+        return false;
+    }
+
+    void* memory = malloc(bytes);
+    if (!memory)
+    {
+        return false;
+    }
+
+    uintptr_t start = AlignUp(reinterpret_cast<uintptr_t>(memory), BlockAlignment);
+    size_t usable = (bytes - (start - reinterpret_cast<uintptr_t>(memory)) - 2 * sizeof(Block)) & ~(BlockAlignment - 1);
+
+    Block* block = reinterpret_cast<Block*>(start);
+    block->previousPhysical = nullptr;
+    block->size = usable | FreeBit;
+
+    Block* end = reinterpret_cast<Block*>(reinterpret_cast<char*>(block + 1) + usable);
+    end->previousPhysical = block;
+    end->size = 0;
+
+    InsertFree(block);
+    pools.push_back(memory);
+    capacity += bytes;
+    return true;
+}
+
+bool TlsfAllocator::MapInsert(size_t size, int& firstLevel, int& secondLevel)
+{
+    const size_t smallBlockSize = static_cast<size_t>(1) << FirstLevelShift;
+    if (size < smallBlockSize)
+    {
+        // Small blocks share the first list row in steps of the block alignment
+        firstLevel = 0;
+        secondLevel = static_cast<int>(size >> AlignmentLog2);
+    }
+    else
+    {
+        int log2 = FindLastSet(size);
+        firstLevel = log2 - (FirstLevelShift - 1);
+        secondLevel = static_cast<int>((size >> (log2 - SecondLevelLog2)) ^ (static_cast<size_t>(1) << SecondLevelLog2));
+    }
+    return firstLevel < FirstLevelCount;
+}
+
+bool TlsfAllocator::MapSearch(size_t size, int& firstLevel, int& secondLevel)
+{
+    // Round up to the next list so every block in the list found is large enough
+    if (size >= (static_cast<size_t>(1) << FirstLevelShift))
+    {
+        size += (static_cast<size_t>(1) << (FindLastSet(size) - SecondLevelLog2)) - 1;
+    }
+    return MapInsert(size, firstLevel, secondLevel);
+}
+
+TlsfAllocator::Block* TlsfAllocator::FindFree(size_t size)
+{
+    int firstLevel, secondLevel;
+    if (!MapSearch(size, firstLevel, secondLevel))
+    {
+        return nullptr;
+    }
+
+    // A list in the same row at or past the rounded class, otherwise the smallest class in a higher row
+    uint32_t secondLevelMap = secondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+    if (!secondLevelMap)
+    {
+        uint32_t firstLevelMap = firstLevel + 1 < FirstLevelCount ? firstLevelBitmap & (~0u << (firstLevel + 1)) : 0;
+        if (!firstLevelMap)
+        {
+            return nullptr;
+        }
+        firstLevel = FindFirstSet(firstLevelMap);
+        secondLevelMap = secondLevelBitmaps[firstLevel];
+    }
+    secondLevel = FindFirstSet(secondLevelMap);
+
+    Block* block = freeLists[firstLevel][secondLevel];
+    RemoveFree(block);
+    block->size &= ~FreeBit;
+    return block;
+}
+
+void TlsfAllocator::InsertFree(Block* block)
+{
+    int firstLevel, secondLevel;
+    MapInsert(SizeOf(block), firstLevel, secondLevel);
+
+    Block* head = freeLists[firstLevel][secondLevel];
+    block->previousFree = nullptr;
+    block->nextFree = head;
+    if (head)
+    {
+        head->previousFree = block;
+    }
+    freeLists[firstLevel][secondLevel] = block;
+    firstLevelBitmap |= 1u << firstLevel;
+    secondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+}
+
+void TlsfAllocator::RemoveFree(Block* block)
+{
+    int firstLevel, secondLevel;
+    MapInsert(SizeOf(block), firstLevel, secondLevel);
+
+    if (block->previousFree)
+    {
+        block->previousFree->nextFree = block->nextFree;
+    }
+    else
+    {
+        freeLists[firstLevel][secondLevel] = block->nextFree;
+    }
+    if (block->nextFree)
+    {
+        block->nextFree->previousFree = block->previousFree;
+    }
+
+    if (!freeLists[firstLevel][secondLevel])
+    {
+        secondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+        if (!secondLevelBitmaps[firstLevel])
+        {
+            firstLevelBitmap &= ~(1u << firstLevel);
+        }
+    }
+}
+
+TlsfAllocator::Block* TlsfAllocator::SplitFront(Block* block, size_t gap)
+{
+    // The block came off a free list, so the block before it is in use and the gap stays a block of its own
+    Block* rest = reinterpret_cast<Block*>(reinterpret_cast<char*>(block + 1) + gap - sizeof(Block));
+    rest->previousPhysical = block;
+    rest->size = block->size - gap;
+    Block* next = reinterpret_cast<Block*>(reinterpret_cast<char*>(rest + 1) + rest->size);
+    next->previousPhysical = rest;
+
+    block->size = (gap - sizeof(Block)) | FreeBit;
+    InsertFree(block);
+    return rest;
+}
+
+void TlsfAllocator::SplitBack(Block* block, size_t size)
+{
+    if (block->size < size + sizeof(Block) + MinBlockSize)
+    {
+        return;
+    }
+
+    // The block after a free list block is in use, so the tail needs no merging
+    Block* rest = reinterpret_cast<Block*>(reinterpret_cast<char*>(block + 1) + size);
+    rest->previousPhysical = block;
+    rest->size = (block->size - size - sizeof(Block)) | FreeBit;
+    Block* next = reinterpret_cast<Block*>(reinterpret_cast<char*>(rest + 1) + SizeOf(rest));
+    next->previousPhysical = rest;
+
+    block->size = size;
+    InsertFree(rest);
+}
+
+size_t TlsfAllocator::SizeOf(const Block* block)
+{
+    return block->size & ~FreeBit;
+}
+
+size_t TlsfAllocator::GetLargestFreeBlockLocked() const
+{
+    if (!firstLevelBitmap)
+    {
+        return 0;
+    }
+
+    // The highest non-empty list holds the largest blocks, its sizes still vary within the class
+    int firstLevel = FindLastSet(firstLevelBitmap);
+    int secondLevel = FindLastSet(secondLevelBitmaps[firstLevel]);
+    size_t largest = 0;
+    for (const Block* block = freeLists[firstLevel][secondLevel]; block; block = block->nextFree)
+    {
+        largest = std::max(largest, SizeOf(block));
+    }
+    return largest;
+}
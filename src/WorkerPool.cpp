@@ -0,0 +1,119 @@
+#include "WorkerPool.h"
+#include <algorithm>
+
+WorkerPool::WorkerPool(unsigned int workerCount) : stopping(false)
+{
+    if (workerCount == 0)
+    {
+        workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+    }
+
+    for (unsigned int i = 0; i < workerCount; ++i)
+    {
+        workers.emplace_back(&WorkerPool::WorkerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(ticketMutex);
+        stopping = true;
+    }
+    ticketAvailable.notify_all();
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+WorkerPool& WorkerPool::Default()
+{
+    static WorkerPool instance;
+    return instance;
+}
+
+unsigned int WorkerPool::GetWorkerCount() const
+{
+    return static_cast<unsigned int>(workers.size());
+}
+
+void WorkerPool::ParallelFor(size_t count, unsigned int threadCount, const std::function<void(size_t)>& task)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    Loop loop;
+    loop.task = &task;
+    loop.count = count;
+    loop.next = 0;
+    loop.running = 0;
+
+    // The caller is one of the threads, workers are only asked for while there is more than one index
+    size_t helpers = threadCount == 0 ? workers.size() : std::min<size_t>(threadCount - 1, workers.size());
+    helpers = std::min(helpers, count - 1);
+    if (helpers > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(ticketMutex);
+            tickets.insert(tickets.end(), helpers, &loop);
+        }
+        ticketAvailable.notify_all();
+    }
+
+    RunLoop(loop);
+
+    // Tickets no worker took yet are withdrawn, only workers already inside the loop are waited for
+    if (helpers > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(ticketMutex);
+            tickets.erase(std::remove(tickets.begin(), tickets.end(), &loop), tickets.end());
+        }
+
+        std::unique_lock<std::mutex> lock(loop.mutex);
+        loop.done.wait(lock, [&loop]() { return loop.running == 0; });
+    }
+}
+
+void WorkerPool::RunLoop(Loop& loop)
+{
+    for (size_t i = loop.next++; i < loop.count; i = loop.next++)
+    {
+        (*loop.task)(i);
+    }
+}
+
+void WorkerPool::WorkerLoop()
+{
+    for (;;)
+    {
+        Loop* loop;
+        {
+            std::unique_lock<std::mutex> lock(ticketMutex);
+            ticketAvailable.wait(lock, [this]() { return stopping || !tickets.empty(); });
+            if (tickets.empty())
+            {
+                return;
+            }
+            loop = tickets.front();
+            tickets.pop_front();
+
+            // Joined while the ticket lock is held, so the caller cannot withdraw the ticket and return in between
+            std::lock_guard<std::mutex> loopLock(loop->mutex);
+            ++loop->running;
+        }
+
+        RunLoop(*loop);
+
+        // The caller owns the loop, signal under its lock so it cannot go away mid-notify
+        std::lock_guard<std::mutex> lock(loop->mutex);
+        if (--loop->running == 0)
+        {
+            loop->done.notify_all();
+        }
+    }
+}